@@ -0,0 +1,93 @@
+// 多路归并的基准测试：比较原来的 priority_queue<kv_info> 写法和败者树 MergingIterator。
+// 每路是一个有序的键数组，路数分别为 8、64、512，总条目数相同。
+// 构建：在仓库根目录执行 make bench，然后运行 ./bench/merge_bench
+#include <chrono>
+#include <cstdio>
+#include <queue>
+#include <random>
+#include <vector>
+#include "../config.h"
+#include "../mergingiterator.h"
+
+struct VectorCursor {
+    const std::vector<uint64_t> *keys;
+    uint64_t rank;
+    size_t pos;
+
+    uint64_t priority() const { return rank; }
+
+    bool valid() const { return pos < keys->size(); }
+
+    void next() { pos++; }
+
+    uint64_t key() const { return (*keys)[pos]; }
+};
+
+static uint64_t mergeWithHeap(const std::vector<std::vector<uint64_t>> &runs) {
+    std::priority_queue<kv_info> kvs;
+    std::vector<size_t> it(runs.size(), 0);
+    for (int i = 0; i < (int) runs.size(); i++) {
+        if (!runs[i].empty()) {
+            kvs.push(kv_info{runs[i][0], 1, (uint64_t) i, 0, i});
+            it[i] = 1;
+        }
+    }
+    uint64_t sum = 0;
+    while (!kvs.empty()) {
+        kv_info min_kv = kvs.top();
+        kvs.pop();
+        sum += min_kv.key;
+        int i = min_kv.i;
+        if (it[i] != runs[i].size()) {
+            kvs.push(kv_info{runs[i][it[i]], 1, min_kv.stamp, 0, i});
+            it[i]++;
+        }
+    }
+    return sum;
+}
+
+static uint64_t mergeWithLoserTree(const std::vector<std::vector<uint64_t>> &runs) {
+    std::vector<VectorCursor> cursors;
+    for (size_t i = 0; i < runs.size(); i++) {
+        cursors.push_back({&runs[i], i, 0});
+    }
+    MergingIterator<VectorCursor> merger(std::move(cursors));
+    uint64_t sum = 0;
+    for (; merger.valid(); merger.next()) {
+        sum += merger.key();
+    }
+    return sum;
+}
+
+template<typename F>
+static double timeIt(F f, uint64_t &result) {
+    auto start = std::chrono::steady_clock::now();
+    result = f();
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+int main() {
+    const size_t total = 1 << 22;
+    std::mt19937_64 rng(42);
+    printf("%8s %12s %12s %8s\n", "inputs", "heap(ms)", "loser(ms)", "speedup");
+    for (int k: {8, 64, 512}) {
+        std::vector<std::vector<uint64_t>> runs(k);
+        for (auto &run: runs) {
+            uint64_t key = 0;
+            for (size_t j = 0; j < total / k; j++) {
+                key += rng() % 16 + 1;
+                run.push_back(key);
+            }
+        }
+        uint64_t a, b;
+        double heapMs = timeIt([&] { return mergeWithHeap(runs); }, a);
+        double loserMs = timeIt([&] { return mergeWithLoserTree(runs); }, b);
+        if (a != b) {
+            printf("result mismatch at %d inputs\n", k);
+            return 1;
+        }
+        printf("%8d %12.1f %12.1f %7.2fx\n", k, heapMs, loserMs, heapMs / loserMs);
+    }
+    return 0;
+}
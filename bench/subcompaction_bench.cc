@@ -0,0 +1,44 @@
+// 子合并的基准测试：同样的写入分别把一次合并最多切成 1、2、4、8 个键范围，比较后台合并追上写入所需的时间。
+// 先顺序写入 N 个键填满第 1 层并溢出到第 2 层，再按打散的顺序覆盖一遍，每个转储出的 SSTable 都横跨整个键范围，
+// 第 0 层每次合并都要重写整个第 1 层，条目数足够切分。计时从覆盖开始，到最后一次合并完成为止。
+// 构建：在仓库根目录执行 make bench，然后运行 ./bench/subcompaction_bench
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <unistd.h>
+#include "../kvstore.h"
+
+int main() {
+    const uint64_t n = 1 << 16;
+    const std::string value(64, 'v');
+    printf("%8s %8s %12s %14s %10s\n", "ranges", "cores", "compactions", "subcompactions", "time(ms)");
+    for (unsigned ranges: {1u, 2u, 4u, 8u}) {
+        KVStore kv("./data/bench", "./data/bench/vlog");
+        kv.reset();
+        kv.setSubcompactions(ranges);
+        for (uint64_t i = 0; i < n; i++) {
+            kv.put(i, value);
+        }
+        compaction_stats before = kv.getCompactionStats();
+        auto start = std::chrono::steady_clock::now();
+        for (uint64_t i = 0; i < n; i++) {
+            kv.put(i * 7 % n, value);
+        }
+        // 合并次数 500ms 不再变化时认为已经追上，结束时间取最后一次变化的时刻
+        compaction_stats after = kv.getCompactionStats();
+        auto last = std::chrono::steady_clock::now();
+        while (std::chrono::steady_clock::now() - last < std::chrono::milliseconds(500)) {
+            usleep(5 * 1000);
+            compaction_stats stats = kv.getCompactionStats();
+            if (stats.compactions + stats.trivial_moves != after.compactions + after.trivial_moves) {
+                after = stats;
+                last = std::chrono::steady_clock::now();
+            }
+        }
+        double ms = std::chrono::duration<double, std::milli>(last - start).count();
+        printf("%8u %8u %12lu %14lu %10.1f\n", ranges, std::thread::hardware_concurrency(),
+               after.compactions - before.compactions, after.subcompactions - before.subcompactions, ms);
+        kv.reset();
+    }
+    return 0;
+}
@@ -1,8 +1,10 @@
 #include "bloomfilter.h"
 
 #include <iostream>
+#include <cassert>
 
 bloomFilter::bloomFilter(int m, int k) : m(m), k(k) {
+    assert(k <= BLOOM_MAX_K);
     set = new bool[m];
     for (int i = 0; i < m; i++) {
         set[i] = false;
@@ -14,28 +16,53 @@ bloomFilter::~bloomFilter() {
 }
 
 void bloomFilter::insert(const uint64_t s) {
-    uint64_t hash[4] = {0};
+    bloomHash h = hash(s, k);
     for (int i = 0; i < k; i++) {
-        MurmurHash3_x64_128(&s, sizeof(s), i, hash);
-        set[hash[0] % m] = true; // 注意这里只用hash[0]，因为你可能不需要4个哈希值
+        set[h.value[i] % m] = true;
     }
 }
 
 bool bloomFilter::query(const uint64_t s) {
-    uint64_t hash[4] = {0};
+    return query(hash(s, k));
+}
+
+bool bloomFilter::query(const bloomHash &h) const {
+    assert(h.k >= k);
     for (int i = 0; i < k; i++) {
-        MurmurHash3_x64_128(&s, sizeof(s), i, hash);
-        if (!set[hash[0] % m]) { // 注意这里只用hash[0]
+        if (!set[h.value[i] % m]) {
             return false;
         }
     }
     return true;
 }
 
+bloomHash bloomFilter::hash(const uint64_t s, int k) {
+    bloomHash h;
+    h.k = k;
+    uint64_t hash[2] = {0};
+    for (int i = 0; i < k; i++) {
+        MurmurHash3_x64_128(&s, sizeof(s), i, hash);
+        h.value[i] = hash[0]; // 注意这里只用hash[0]，与写入磁盘的过滤器保持一致
+    }
+    return h;
+}
+
+void bloomFilter::queryBatch(const std::vector<const bloomFilter *> &filters, const bloomHash &h,
+                             std::vector<char> &hits) {
+    hits.assign(filters.size(), 0);
+    for (size_t j = 0; j < filters.size(); j++) {
+        hits[j] = filters[j]->query(h);
+    }
+}
+
 bool* bloomFilter::getSet() {
     return set;
 }
 
 int bloomFilter::getM() {
     return m;
-}
\ No newline at end of file
+}
+
+int bloomFilter::getK() const {
+    return k;
+}
@@ -3,8 +3,18 @@
 
 #include <bitset>
 #include <string>
+#include <vector>
 #include "MurmurHash3.h"
 
+//单个键最多预先计算的哈希函数个数
+#define BLOOM_MAX_K 8
+
+//一个键的哈希结果，一次查找只计算一次，在所有过滤器上复用
+struct bloomHash {
+    int k;
+    uint64_t value[BLOOM_MAX_K];
+};
+
 class bloomFilter {
 
 private:
@@ -17,8 +27,16 @@ public:
     ~bloomFilter();
     void insert(const uint64_t s);
     bool query(const uint64_t s);
+    //使用预先计算好的哈希值查询，不再重复计算 MurmurHash3
+    bool query(const bloomHash &h) const;
+    //计算键的 k 个哈希值
+    static bloomHash hash(const uint64_t s, int k);
+    //用同一组哈希值依次查询多个过滤器，hits[i] 表示 filters[i] 是否可能包含该键
+    static void queryBatch(const std::vector<const bloomFilter *> &filters, const bloomHash &h,
+                           std::vector<char> &hits);
     bool* getSet();
     int getM();
+    int getK() const;
 };
 
-#endif //BLOOMFILTER_H
\ No newline at end of file
+#endif //BLOOMFILTER_H
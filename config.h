@@ -20,6 +20,9 @@
 
 #define BLOOMSIZE 8192
 
+//布隆过滤器使用的哈希函数个数
+#define BLOOMHASHNUM 3
+
 #define BUFFER_SIZE (1024 * 64 + 5)
 
 #define HEAD -0x7ffffff
@@ -28,7 +31,82 @@
 
 #define NONE "NONE"
 
-#define MINKEY 0x7fffffff
+#define MINKEY 0xffffffffffffffff
+
+//vlog 值缓存的默认容量（字节）
+#define VALUECACHE_CAPACITY (64 * 1024 * 1024)
+
+//值缓存的分片数为 2^VALUECACHE_SHARD_BITS
+#define VALUECACHE_SHARD_BITS 4
+
+//批量读取 vlog 时，间隔不超过该字节数的相邻读请求合并为一次读取
+#define COALESCE_GAP (4 * 1024)
+
+//合并后单次读取 vlog 的最大字节数
+#define COALESCE_MAX (1024 * 1024)
+
+//异步读后端同时在途的读请求数
+#define IO_QUEUE_DEPTH 64
+
+//io_uring 不可用时线程池的线程数
+#define IO_THREADS 8
+
+//gc 按这个大小把 vlog 分块，一次提交所有块的读取
+#define GC_READ_BLOCK (64 * 1024)
+
+//长度小于该值的值直接内联存放在 SSTable 中，不写入 vlog；0 表示不内联
+#define INLINE_THRESHOLD 32
+
+//SSTable 条目中值长度的最高位，置位表示值内联存放，此时偏移量是值在 SSTable 内联区中的位置
+#define INLINE_FLAG 0x80000000ULL
+
+//第 0 层的 SSTable 数达到该值时合并到第 1 层
+#define L0_COMPACTION_TRIGGER 4
+
+//第 1 层的目标字节数，超过目标的层需要合并到下一层
+#define LEVEL_BASE_BYTES (256 * 1024)
+
+//每往下一层，目标字节数乘以该倍数
+#define LEVEL_MULTIPLIER 10
+
+//第 0 层的 SSTable 数超过该值时，写入等待后台合并追上
+#define L0_STOP_TRIGGER 12
+
+//默认的合并策略，构造 KVStore 时可以另外指定
+#define COMPACTION_STYLE LEVELED_COMPACTION
+
+//FIFO 合并时 SSTable 和 vlog 占用的字节数上限，超过后从最旧的 SSTable 开始删除；0 表示不限
+#define FIFO_MAX_BYTES (1024ULL * 1024 * 1024)
+
+//FIFO 合并时 SSTable 的最长保留时间（秒），0 表示不限
+#define FIFO_TTL_SECONDS 0
+
+//FIFO 合并设置了保留时间时，后台线程至少每隔这么多毫秒检查一次过期的 SSTable
+#define FIFO_CHECK_INTERVAL_MS 1000
+
+//一个 SSTable 的过滤器放行但没有找到键的点查次数达到该值时，把它合并到下一层（seek compaction）；0 表示不触发
+#define SEEK_COMPACTION_TRIGGER 100
+
+//分层（tiered）合并时，一层积累到这么多个有序段（sorted run）就把最旧的这些段合并成一个段放到下一层
+#define TIER_RUNS 4
+
+//一次合并最多按下一层 SSTable 的边界切成这么多个键范围，在各自的线程上并行归并；实际不超过核数，
+//可以用 KVStore::setSubcompactions 在运行时调整。第 0 层合并的输入通常是几个转储文件加上整个第 1 层，
+//约 8K 个条目，按每个范围至少 SUBCOMPACTION_MIN_ENTRIES 个条目最多切成 4 个；bench/subcompaction_bench 比较不同取值
+#define SUBCOMPACTIONS 4
+
+//每个键范围至少有这么多个输入条目才继续切分，小的合并不值得开线程
+#define SUBCOMPACTION_MIN_ENTRIES 2048
+
+//后台 I/O（转储、合并写出、gc 读取 vlog）的默认限速（字节/秒），0 表示不限速
+#define RATE_LIMIT_BYTES_PER_SEC 0
+
+//限速器的令牌最多积累这么多毫秒的量，空闲之后允许的突发
+#define RATE_LIMIT_BURST_MS 100
+
+//为新写出的 SSTable 建立哈希索引（键到条目下标），追加在键数组之后，点查时代替二分查找。
+//索引约占 4KB，计入 SSTABLESIZE，默认关闭，可以用 KVStore::setHashIndex 在运行时打开
+#define SST_HASH_INDEX 0
 
 struct kv {
     std::pair<uint64_t, std::string> kv_pair; // 键值对
@@ -64,6 +142,62 @@ struct kv_info {
     }
 };
 
+struct vlog_read {
+    off_t offset; // vlog 条目的偏移量
+    uint64_t valueLen; // 值的长度
+    int slot; // 读出的值写回结果中的位置
+
+    // 运算符重载 <
+    bool operator<(const vlog_read& other) const {
+        return offset < other.offset;
+    }
+};
+
+struct fence {
+    uint64_t min_key; // SSTable 的最小键
+    uint64_t max_key; // SSTable 的最大键
+};
+
+struct range_size {
+    uint64_t keys; // 范围内的条目数，包括旧版本和删除标记
+    uint64_t bytes; // 这些条目在 SSTable 和 vlog 中占用的字节数
+};
+
+struct compaction_stats {
+    uint64_t compactions; // 完成的合并次数
+    uint64_t input_files; // 读入的 SSTable 数
+    uint64_t output_files; // 写出的 SSTable 数
+    uint64_t input_entries; // 读入的条目数
+    uint64_t output_entries; // 写出的条目数
+    uint64_t dropped_versions; // 被同一个键更新的版本遮住而丢弃的条目数
+    uint64_t dropped_tombstones; // 写入最底层时丢弃的删除标记数
+    uint64_t bytes_written; // 写出的 SSTable 字节数
+    uint64_t trivial_moves; // 与下一层不重叠、只改元数据直接移到下一层的 SSTable 数，不计入上面各项
+    uint64_t expired_files; // FIFO 合并时因为超出大小或时间限制删除的 SSTable 数
+    uint64_t seek_compactions; // 因为点查白白探测某个 SSTable 太多次而触发的合并次数
+    uint64_t subcompactions; // 各次合并切成的键范围数之和，不切分的合并计 1
+};
+
+//合并策略：LEVELED_COMPACTION 每层（第 0 层除外）只有一个互不重叠的有序段，推下去时重写下一层的重叠部分；
+//TIERED_COMPACTION 每层可以有多个互相重叠的有序段，只合并本层的段而不重写下一层，写放大小但点查要探测更多文件；
+//FIFO_COMPACTION 从不合并，所有 SSTable 留在第 0 层，超过大小或时间限制时删除最旧的 SSTable 并回收它们的 vlog 空间，
+//适合只保留最近数据的时间序列，写放大约为 1
+enum compaction_style {
+    LEVELED_COMPACTION,
+    TIERED_COMPACTION,
+    FIFO_COMPACTION
+};
+
+struct amplification_stats {
+    uint64_t user_bytes; // 本次打开以来 put 和 del 写入的键和值的字节数
+    uint64_t flush_bytes; // 内存表转储写出的 vlog 和 SSTable 字节数，包括 gc 搬运的值
+    uint64_t compaction_bytes; // 合并写出的 SSTable 字节数
+    uint64_t live_bytes; // 当前所有存活键的键和值的字节数
+    uint64_t disk_bytes; // SSTable 和 vlog 当前占用的磁盘字节数
+    double write_amp; // (flush_bytes + compaction_bytes) / user_bytes
+    double space_amp; // disk_bytes / live_bytes
+};
+
 struct sst_info {
     int level;
     int id;
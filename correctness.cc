@@ -2,6 +2,7 @@
 #include <cstdint>
 #include <string>
 #include <assert.h>
+#include <map>
 
 #include "test.h"
 
@@ -11,6 +12,15 @@ private:
 	const uint64_t SIMPLE_TEST_MAX = 512;
 	const uint64_t LARGE_TEST_MAX = 1024 * 64;
 	const uint64_t GC_TEST_MAX = 1024 * 48;
+	const uint64_t FEATURE_TEST_MAX = 1024 * 8;
+
+	const std::string dir;
+
+	// Short values are stored inline in the SSTables, longer ones in the vlog
+	std::string value_of(uint64_t i, char c)
+	{
+		return std::string(i % 64 + 1, c);
+	}
 
 	void regular_test(uint64_t max)
 	{
@@ -191,8 +201,578 @@ private:
 		report();
 	}
 
+	void multiget_test(uint64_t max)
+	{
+		uint64_t i;
+
+		for (i = 0; i < max; ++i)
+			store.put(i, value_of(i, 'm'));
+		for (i = 0; i < max; i += 5)
+			store.del(i);
+		// The newest versions of these stay in the memtable
+		for (i = 0; i < max / 8; ++i)
+			store.put(i * 3, value_of(i, 'u'));
+
+		auto expected = [&](uint64_t key) {
+			if (key >= max)
+				return not_found;
+			if (key % 3 == 0 && key / 3 < max / 8)
+				return value_of(key / 3, 'u');
+			return key % 5 == 0 ? not_found : value_of(key, 'm');
+		};
+
+		// Every key twice, out of order, with keys that were never written
+		std::vector<uint64_t> keys;
+		for (i = 0; i < max + 64; ++i)
+			keys.push_back(max + 63 - i);
+		for (i = 0; i < max + 64; i += 2)
+			keys.push_back(i);
+		std::vector<std::string> vals = store.multiGet(keys);
+		EXPECT(keys.size(), vals.size());
+		for (i = 0; i < keys.size() && i < vals.size(); ++i)
+		{
+			const std::string &val = vals[i];
+			EXPECT(expected(keys[i]), val);
+			EXPECT(store.get(keys[i]), val);
+		}
+		phase();
+
+		// A batch that reads the vlog twice for the same entry
+		keys.assign(64, 1);
+		vals = store.multiGet(keys);
+		EXPECT(keys.size(), vals.size());
+		for (const std::string &val : vals)
+			EXPECT(value_of(1, 'm'), val);
+		EXPECT((size_t)0, store.multiGet(std::vector<uint64_t>()).size());
+		phase();
+
+		report();
+	}
+
+	void handle_test(uint64_t max)
+	{
+		uint64_t i;
+		ValueHandle handle;
+
+		for (i = 0; i < max; ++i)
+			store.put(i, value_of(i, 'h'));
+		for (i = 0; i < max; i += 7)
+			store.del(i);
+		// Values in the vlog, inline in SSTables and in the memtable
+		for (i = 0; i < max + 16; ++i)
+		{
+			bool found = i < max && i % 7 != 0;
+			EXPECT(found, store.get(i, handle));
+			EXPECT(found ? value_of(i, 'h') : not_found, handle.toString());
+			EXPECT(found ? i % 64 + 1 : 0, (uint64_t)handle.size());
+		}
+		phase();
+
+		// A handle keeps pointing at the value it was read from after the
+		// key is overwritten and the new version is flushed; this value is
+		// long enough to live in the vlog
+		uint64_t key = 40;
+		EXPECT(true, store.get(key, handle));
+		ValueHandle old = handle;
+		for (i = 0; i < max; ++i)
+			store.put(i, value_of(i, 'n'));
+		EXPECT(value_of(key, 'h'), old.toString());
+		EXPECT(true, store.get(key, handle));
+		EXPECT(value_of(key, 'n'), handle.toString());
+		EXPECT(value_of(key, 'h'), old.toString());
+		phase();
+
+		report();
+	}
+
+	Task<void> async_get(EventLoop &loop, uint64_t key, std::string &val)
+	{
+		val = co_await store.getAsync(loop, key);
+	}
+
+	void async_test(uint64_t max)
+	{
+		uint64_t i;
+		EventLoop loop;
+
+		for (i = 0; i < max; ++i)
+			store.put(i, value_of(i, 'a'));
+		for (i = 0; i < max; i += 6)
+			store.del(i);
+		for (i = 0; i < max; i += 9)
+			store.put(i, value_of(i, 'b'));
+
+		auto expected = [&](uint64_t key) {
+			if (key >= max)
+				return not_found;
+			if (key % 9 == 0)
+				return value_of(key, 'b');
+			return key % 6 == 0 ? not_found : value_of(key, 'a');
+		};
+
+		// One lookup at a time, then all of them suspended on the same loop
+		for (i = 0; i < max + 16; i += 3)
+		{
+			Task<std::string> task = store.getAsync(loop, i);
+			EXPECT(expected(i), loop.runUntilComplete(task));
+		}
+		std::vector<std::string> vals(max + 16);
+		for (i = 0; i < max + 16; ++i)
+			loop.spawn(async_get(loop, i, vals[i]));
+		loop.run();
+		for (i = 0; i < max + 16; ++i)
+		{
+			const std::string &val = vals[i];
+			EXPECT(expected(i), val);
+		}
+		phase();
+
+		// scanAsync returns the same pairs as scan
+		std::list<std::pair<uint64_t, std::string>> list_ans;
+		store.scan(max / 4, max - 1, list_ans);
+		Task<std::list<std::pair<uint64_t, std::string>>> scan = store.scanAsync(loop, max / 4, max - 1);
+		std::list<std::pair<uint64_t, std::string>> list_stu = loop.runUntilComplete(scan);
+		EXPECT(list_ans.size(), list_stu.size());
+		EXPECT(true, list_ans == list_stu);
+		Task<std::list<std::pair<uint64_t, std::string>>> empty = store.scanAsync(loop, max, max - 1);
+		EXPECT((size_t)0, loop.runUntilComplete(empty).size());
+		phase();
+
+		// gc moving the values while the reads are in flight
+		store.setCacheCapacity(0);
+		std::atomic<bool> stop(false);
+		std::thread gc([&]() {
+			while (!stop)
+				store.gc(256 * 1024);
+		});
+		for (int round = 0; round < 4; ++round)
+		{
+			for (i = 0; i < max; ++i)
+				loop.spawn(async_get(loop, i, vals[i]));
+			loop.run();
+			for (i = 0; i < max; ++i)
+			{
+				const std::string &val = vals[i];
+				EXPECT(expected(i), val);
+			}
+			scan = store.scanAsync(loop, 0, max - 1);
+			list_stu = loop.runUntilComplete(scan);
+			EXPECT(store.countRange(0, max - 1), (uint64_t)list_stu.size());
+			for (auto &kv : list_stu)
+				EXPECT(expected(kv.first), kv.second);
+		}
+		stop = true;
+		gc.join();
+		store.setCacheCapacity(VALUECACHE_CAPACITY);
+		phase();
+
+		report();
+	}
+
+	void iterator_test(uint64_t max)
+	{
+		uint64_t i;
+
+		// Even keys only, every fourth one deleted, a few in the memtable
+		for (i = 0; i < max; i += 2)
+			store.put(i, value_of(i, 'i'));
+		for (i = 0; i < max; i += 8)
+			store.del(i);
+		for (i = 2; i < max; i += 64)
+			store.put(i, value_of(i, 'j'));
+
+		auto live = [&](uint64_t key) {
+			return key < max && key % 2 == 0 && key % 8 != 0;
+		};
+		auto expected = [&](uint64_t key) {
+			return value_of(key, (key - 2) % 64 == 0 ? 'j' : 'i');
+		};
+
+		std::list<std::pair<uint64_t, std::string>> list_ans;
+		store.scan(0, max, list_ans);
+		Iterator *iter = store.newIterator();
+		std::list<std::pair<uint64_t, std::string>> list_stu;
+		for (iter->seekToFirst(); iter->valid(); iter->next())
+			list_stu.emplace_back(iter->key(), iter->value());
+		EXPECT(list_ans.size(), list_stu.size());
+		EXPECT(true, list_ans == list_stu);
+
+		// seek lands on the first live key not less than the target
+		for (i = 0; i < max + 8; i += 3)
+		{
+			uint64_t next = i;
+			while (next < max && !live(next))
+				++next;
+			iter->seek(i);
+			EXPECT(next < max, iter->valid());
+			if (iter->valid())
+			{
+				EXPECT(next, iter->key());
+				EXPECT(expected(next), iter->value());
+			}
+		}
+		phase();
+
+		// Reverse iteration visits the same keys backwards
+		list_stu.clear();
+		for (iter->seekToLast(); iter->valid(); iter->prev())
+			list_stu.emplace_front(iter->key(), iter->value());
+		EXPECT(true, list_ans == list_stu);
+
+		for (i = 0; i < max + 8; i += 5)
+		{
+			uint64_t prev = std::min(i, max - 1);
+			while (prev > 0 && !live(prev))
+				--prev;
+			iter->seekForPrev(i);
+			EXPECT(live(prev), iter->valid());
+			if (iter->valid())
+			{
+				EXPECT(prev, iter->key());
+				iter->prev();
+				if (iter->valid())
+					EXPECT(true, iter->key() < prev && live(iter->key()));
+			}
+		}
+		delete iter;
+		phase();
+
+		report();
+	}
+
+	void limit_scan_test(uint64_t max)
+	{
+		uint64_t i;
+
+		for (i = 0; i < max; ++i)
+			store.put(i, value_of(i, 'l'));
+		for (i = 0; i < max; i += 3)
+			store.del(i);
+
+		// Limits below, at and above the number of live keys in the range
+		const uint64_t ranges[][3] = {
+			{0, max - 1, 1}, {0, max - 1, 100}, {max / 3, max / 2, 0}, {max / 3, max / 2, 50},
+			{max / 3, max / 2, max}, {max - 10, max + 10, 5}, {3, 3, 10}, {4, 4, 10}};
+		for (const auto &range : ranges)
+		{
+			for (int reverse = 0; reverse < 2; ++reverse)
+			{
+				std::list<std::pair<uint64_t, std::string>> list_ans;
+				for (i = 0; i <= range[1] - range[0] && list_ans.size() < range[2]; ++i)
+				{
+					uint64_t key = reverse ? range[1] - i : range[0] + i;
+					if (key < max && key % 3 != 0)
+						list_ans.emplace_back(key, value_of(key, 'l'));
+				}
+				std::list<std::pair<uint64_t, std::string>> list_stu;
+				store.scan(range[0], range[1], range[2], reverse, list_stu);
+				EXPECT(list_ans.size(), list_stu.size());
+				EXPECT(true, list_ans == list_stu);
+			}
+		}
+		std::list<std::pair<uint64_t, std::string>> list_stu;
+		store.scan(max / 2, max / 3, 10, true, list_stu);
+		EXPECT((size_t)0, list_stu.size());
+		phase();
+
+		report();
+	}
+
+	void range_count_test(uint64_t max)
+	{
+		uint64_t i;
+
+		// Every key written exactly once, so the estimate has nothing to overcount
+		for (i = 0; i < max; ++i)
+			store.put(i, value_of(i, 'c'));
+		uint64_t bytes = 0;
+		for (i = max / 4; i < max / 2; ++i)
+			bytes += KOVSIZE + i % 64 + 1;
+		range_size size = store.approximateSize(max / 4, max / 2 - 1);
+		EXPECT(max / 4, size.keys);
+		EXPECT(true, size.bytes >= bytes);
+		size = store.approximateSize(max, max * 2);
+		EXPECT((uint64_t)0, size.keys);
+		EXPECT((uint64_t)0, size.bytes);
+		EXPECT((uint64_t)0, store.approximateSize(max / 2, max / 4).keys);
+		phase();
+
+		for (i = 1; i < max; i += 4)
+			store.del(i);
+		const uint64_t ranges[][2] = {{0, max - 1}, {max / 3, max / 2}, {5, 5}, {1, 1}, {max - 5, max + 5}};
+		for (const auto &range : ranges)
+		{
+			std::vector<uint64_t> keys_ans;
+			for (i = range[0]; i <= range[1] && i < max; ++i)
+				if (i % 4 != 1)
+					keys_ans.push_back(i);
+			std::vector<uint64_t> keys_stu = store.scanKeys(range[0], range[1]);
+			EXPECT(keys_ans.size(), keys_stu.size());
+			EXPECT(true, keys_ans == keys_stu);
+			EXPECT((uint64_t)keys_ans.size(), store.countRange(range[0], range[1]));
+			// Tombstones are still counted until a compaction drops them
+			EXPECT(true, store.approximateSize(range[0], range[1]).keys >= keys_ans.size());
+		}
+		EXPECT((size_t)0, store.scanKeys(max / 2, max / 3).size());
+		EXPECT((uint64_t)0, store.countRange(max / 2, max / 3));
+		phase();
+
+		report();
+	}
+
+	void rate_limit_test(uint64_t max)
+	{
+		uint64_t i;
+
+		// High priority requests overdraw the bucket, low priority ones wait
+		// until the debt is paid off
+		RateLimiter limiter(MB);
+		auto start = std::chrono::steady_clock::now();
+		limiter.request(MB / 2, IO_HIGH);
+		limiter.request(1, IO_LOW);
+		double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		EXPECT(true, elapsed >= 0.3);
+		rate_limiter_stats stats = limiter.getStats();
+		EXPECT((uint64_t)(MB / 2), stats.high_bytes);
+		EXPECT((uint64_t)1, stats.low_bytes);
+		EXPECT((uint64_t)1, stats.waits);
+		EXPECT(true, stats.wait_us >= 300000);
+
+		// Lifting the limit releases a request that is already waiting
+		limiter.setBytesPerSecond(1);
+		limiter.request(MB, IO_HIGH);
+		std::thread waiter([&]() { limiter.request(1, IO_LOW); });
+		usleep(100 * 1000);
+		start = std::chrono::steady_clock::now();
+		limiter.setBytesPerSecond(0);
+		waiter.join();
+		elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		EXPECT(true, elapsed < 1);
+		EXPECT((uint64_t)0, limiter.getBytesPerSecond());
+		EXPECT((uint64_t)2, limiter.getStats().waits);
+		phase();
+
+		// Flushes are charged as high priority, gc as low priority
+		EXPECT((uint64_t)RATE_LIMIT_BYTES_PER_SEC, store.getRateLimit());
+		store.setRateLimit(64 * MB);
+		EXPECT((uint64_t)(64 * MB), store.getRateLimit());
+		stats = store.getRateLimiterStats();
+		for (i = 0; i < max; ++i)
+			store.put(i, value_of(i, 'r'));
+		for (i = 0; i < max; ++i)
+			store.put(i, value_of(i, 's'));
+		EXPECT(true, store.getRateLimiterStats().high_bytes > stats.high_bytes);
+		check_gc(MB / 4);
+		EXPECT(true, store.getRateLimiterStats().low_bytes >= stats.low_bytes + MB / 4);
+		for (i = 0; i < max; ++i)
+			EXPECT(value_of(i, 's'), store.get(i));
+		store.setRateLimit(0);
+		EXPECT((uint64_t)0, store.getRateLimit());
+		phase();
+
+		report();
+	}
+
+	// Wait up to 10s for the background thread to finish the given work
+	template <typename F>
+	void wait_compactions(F done)
+	{
+		for (int i = 0; i < 1000 && !done(store.getCompactionStats()); ++i)
+			usleep(10 * 1000);
+	}
+
+	// Wait until the background thread stops finding work
+	void wait_settled()
+	{
+		// Settled once nothing has finished for half a second
+		uint64_t done = ~0ULL;
+		for (int t = 0, quiet = 0; t < 200 && quiet < 5; ++t)
+		{
+			compaction_stats stats = store.getCompactionStats();
+			quiet = stats.compactions + stats.trivial_moves == done ? quiet + 1 : 0;
+			done = stats.compactions + stats.trivial_moves;
+			usleep(100 * 1000);
+		}
+	}
+
+	void trivial_move_test(uint64_t max)
+	{
+		uint64_t i;
+
+		// Ascending keys never overlap what is already on disk, so every
+		// compaction just moves files down
+		compaction_stats before = store.getCompactionStats();
+		for (i = 0; i < max * 4; ++i)
+			store.put(i, value_of(i, 't'));
+		wait_compactions([&](const compaction_stats &stats) {
+			return stats.trivial_moves > before.trivial_moves;
+		});
+		compaction_stats after = store.getCompactionStats();
+		EXPECT(true, after.trivial_moves > before.trivial_moves);
+		EXPECT(before.compactions, after.compactions);
+		EXPECT(before.bytes_written, after.bytes_written);
+		for (i = 0; i < max * 4; ++i)
+			EXPECT(value_of(i, 't'), store.get(i));
+		phase();
+
+		// Overwriting the same range overlaps the moved files and needs a merge
+		before = after;
+		for (i = 0; i < max * 4; i += 2)
+			store.put(i, value_of(i, 'u'));
+		wait_compactions([&](const compaction_stats &stats) {
+			return stats.compactions > before.compactions;
+		});
+		after = store.getCompactionStats();
+		EXPECT(true, after.compactions > before.compactions);
+		for (i = 0; i < max * 4; ++i)
+			EXPECT(value_of(i, i % 2 ? 't' : 'u'), store.get(i));
+		EXPECT(max * 4, store.countRange(0, max * 4));
+		phase();
+
+		report();
+	}
+
+	void tombstone_test(uint64_t max)
+	{
+		uint64_t i;
+		const uint64_t len = 64;
+
+		// Everything fits in level 1, so merging the tombstones into it writes
+		// the bottommost level and drops them together with the old versions
+		compaction_stats before = store.getCompactionStats();
+		for (i = 0; i < max / 4; ++i)
+			store.put(i, std::string(len, 'd'));
+		for (i = max / 16; i < max / 8; ++i)
+			store.del(i);
+		for (i = max / 4; i < max / 2; ++i)
+			store.put(i, std::string(len, 'd'));
+		wait_compactions([&](const compaction_stats &stats) {
+			return stats.dropped_tombstones >= before.dropped_tombstones + max / 16;
+		});
+		EXPECT(true, store.getCompactionStats().dropped_tombstones > before.dropped_tombstones);
+		EXPECT(max / 4 - max / 16, store.approximateSize(0, max / 4 - 1).keys);
+		EXPECT((uint64_t)0, store.approximateSize(max / 16, max / 8 - 1).keys);
+		for (i = 0; i < max / 4; ++i)
+			EXPECT(i >= max / 16 && i < max / 8 ? not_found : std::string(len, 'd'), store.get(i));
+		EXPECT((size_t)0, store.scanKeys(max / 16, max / 8 - 1).size());
+		EXPECT(max / 4 - max / 16, store.countRange(0, max / 4 - 1));
+		phase();
+
+		// Once the old versions have been pushed below level 1, tombstones
+		// merged into level 1 still have to shadow them and are kept
+		store.reset();
+		for (i = 0; i < max * 2; ++i)
+			store.put(i, std::string(len, 'e'));
+		wait_settled();
+		before = store.getCompactionStats();
+		for (i = 0; i < max / 16; ++i)
+			store.del(i);
+		for (i = max * 2; i < max * 2 + max / 4; ++i)
+			store.put(i, std::string(len, 'e'));
+		wait_compactions([&](const compaction_stats &stats) {
+			return stats.compactions > before.compactions;
+		});
+		EXPECT(before.dropped_tombstones, store.getCompactionStats().dropped_tombstones);
+		EXPECT(max / 8, store.approximateSize(0, max / 16 - 1).keys);
+		for (i = 0; i < max / 8; ++i)
+			EXPECT(i < max / 16 ? not_found : std::string(len, 'e'), store.get(i));
+		EXPECT((size_t)0, store.scanKeys(0, max / 16 - 1).size());
+		EXPECT(max * 2 + max / 4 - max / 16, store.countRange(0, max * 3));
+		phase();
+
+		report();
+	}
+
+	// Every level below 0 is sorted by key and its tables do not overlap
+	bool levels_sorted()
+	{
+		std::vector<std::string> files;
+		std::map<int, std::map<int, std::string>> levels;
+		utils::scanDir(dir, files);
+		for (const auto &file : files)
+		{
+			size_t dash = file.find('-');
+			if (dash == std::string::npos || file.find(".sst") == std::string::npos)
+				continue;
+			int level = std::stoi(file.substr(0, dash));
+			if (level)
+				levels[level][std::stoi(file.substr(dash + 1))] = file;
+		}
+		for (const auto &level : levels)
+		{
+			bool first = true;
+			uint64_t last = 0;
+			for (const auto &table : level.second)
+			{
+				SSTable sst(level.first, table.first, table.second, dir, nullptr, BLOOMSIZE);
+				for (uint64_t i = 0; i < sst.get_numkv(); ++i)
+				{
+					if (!first && sst.keyAt(i) <= last)
+						return false;
+					first = false;
+					last = sst.keyAt(i);
+				}
+			}
+		}
+		return true;
+	}
+
+	void subcompaction_test(uint64_t max)
+	{
+		uint64_t i;
+		const uint64_t len = 64;
+		unsigned ranges = store.getSubcompactions();
+
+		// Fill level 1 and spill into level 2, then overwrite in a scattered
+		// order so every flushed table spans the whole key range and each
+		// merge from level 0 rewrites all of level 1, enough to be split
+		store.setSubcompactions(SUBCOMPACTIONS);
+		EXPECT((unsigned)SUBCOMPACTIONS, store.getSubcompactions());
+		compaction_stats before = store.getCompactionStats();
+		for (i = 0; i < max * 2; ++i)
+			store.put(i, std::string(len, 'k'));
+		for (i = 0; i < max * 2; ++i)
+			store.put(i * 7 % (max * 2), std::string(len, 'l'));
+		wait_compactions([&](const compaction_stats &stats) {
+			return stats.subcompactions - before.subcompactions > stats.compactions - before.compactions;
+		});
+		wait_settled();
+		compaction_stats after = store.getCompactionStats();
+		EXPECT(true, after.subcompactions - before.subcompactions > after.compactions - before.compactions);
+		EXPECT(after.input_entries - before.input_entries,
+			   after.output_entries - before.output_entries + after.dropped_versions - before.dropped_versions +
+				   after.dropped_tombstones - before.dropped_tombstones);
+		// Ranges merged in parallel are installed in key order
+		EXPECT(true, levels_sorted());
+		for (i = 0; i < max * 2; ++i)
+			EXPECT(std::string(len, 'l'), store.get(i));
+		EXPECT(max * 2, store.countRange(0, max * 2));
+		phase();
+
+		// With splitting turned off every compaction merges a single range
+		store.reset();
+		store.setSubcompactions(0);
+		EXPECT(1u, store.getSubcompactions());
+		before = store.getCompactionStats();
+		for (i = 0; i < max * 2; ++i)
+			store.put(i, std::string(len, 'k'));
+		for (i = 0; i < max * 2; ++i)
+			store.put(i * 7 % (max * 2), std::string(len, 'l'));
+		wait_settled();
+		after = store.getCompactionStats();
+		EXPECT(true, after.compactions > before.compactions);
+		EXPECT(after.compactions - before.compactions, after.subcompactions - before.subcompactions);
+		EXPECT(true, levels_sorted());
+		for (i = 0; i < max * 2; ++i)
+			EXPECT(std::string(len, 'l'), store.get(i));
+		store.setSubcompactions(ranges);
+		phase();
+
+		report();
+	}
+
 public:
-	CorrectnessTest(const std::string &dir, const std::string &vlog, bool v = true) : Test(dir, vlog, v)
+	CorrectnessTest(const std::string &dir, const std::string &vlog, bool v = true) : Test(dir, vlog, v), dir(dir)
 	{
 	}
 
@@ -214,6 +794,56 @@ public:
 
 		std::cout << "[GC Test]" << std::endl;
 		gc_test(GC_TEST_MAX);
+
+		store.reset();
+
+		std::cout << "[MultiGet Test]" << std::endl;
+		multiget_test(FEATURE_TEST_MAX);
+
+		store.reset();
+
+		std::cout << "[Value Handle Test]" << std::endl;
+		handle_test(FEATURE_TEST_MAX);
+
+		store.reset();
+
+		std::cout << "[Async Test]" << std::endl;
+		async_test(FEATURE_TEST_MAX);
+
+		store.reset();
+
+		std::cout << "[Iterator Test]" << std::endl;
+		iterator_test(FEATURE_TEST_MAX);
+
+		store.reset();
+
+		std::cout << "[Limit Scan Test]" << std::endl;
+		limit_scan_test(FEATURE_TEST_MAX);
+
+		store.reset();
+
+		std::cout << "[Range Count Test]" << std::endl;
+		range_count_test(FEATURE_TEST_MAX);
+
+		store.reset();
+
+		std::cout << "[Rate Limit Test]" << std::endl;
+		rate_limit_test(FEATURE_TEST_MAX);
+
+		store.reset();
+
+		std::cout << "[Trivial Move Test]" << std::endl;
+		trivial_move_test(FEATURE_TEST_MAX);
+
+		store.reset();
+
+		std::cout << "[Tombstone Test]" << std::endl;
+		tombstone_test(FEATURE_TEST_MAX);
+
+		store.reset();
+
+		std::cout << "[Subcompaction Test]" << std::endl;
+		subcompaction_test(FEATURE_TEST_MAX);
 	}
 };
 
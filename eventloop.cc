@@ -0,0 +1,96 @@
+#include "eventloop.h"
+#include "config.h"
+#include <cerrno>
+
+EventLoop::EventLoop() {
+    //事件循环使用自己的后端，不与 KVStore 的批量读取争抢完成队列
+    io = IOBackend::create(IO_QUEUE_DEPTH, IO_THREADS);
+}
+
+EventLoop::~EventLoop() {
+    delete io;
+}
+
+const char *EventLoop::backendName() const {
+    return io->name();
+}
+
+void EventLoop::submit(io_request *req) {
+    if (io->inflight() < (int) io->getDepth()) {
+        io->submit(req);
+    } else {
+        backlog.push_back(req);
+    }
+}
+
+void EventLoop::reapCompleted(bool wait) {
+    std::vector<io_request *> done;
+    if (io->reap(done, wait) < 0) {
+        // 后端出错时在途的请求永远等不到完成，run() 会一直重试失败的系统调用。先等后端放开请求的缓冲区，
+        // 再让没有读完的请求和暂存的请求都以 -EIO 结束，等待它们的协程照常恢复，读取按失败处理
+        io->drain(done);
+        for (io_request *req: done) {
+            if (req->result == -ECANCELED) {
+                req->result = -EIO;
+            }
+        }
+        for (io_request *req: backlog) {
+            req->result = -EIO;
+            done.push_back(req);
+        }
+        backlog.clear();
+    }
+    for (io_request *req: done) {
+        Waiter *waiter = (Waiter *) req->user;
+        if (--waiter->remaining == 0) {
+            ready.push_back(waiter->handle);
+        }
+    }
+    // 腾出的位置交给暂存的请求
+    while (!backlog.empty() && io->inflight() < (int) io->getDepth()) {
+        io->submit(backlog.front());
+        backlog.pop_front();
+    }
+}
+
+EventLoop::BatchAwaiter EventLoop::readAll(std::vector<io_request> &reqs) {
+    return BatchAwaiter(*this, reqs);
+}
+
+void EventLoop::BatchAwaiter::await_suspend(std::coroutine_handle<> h) {
+    waiter.handle = h;
+    waiter.remaining = reqs.size();
+    for (auto &req: reqs) {
+        req.user = &waiter;
+        loop.submit(&req);
+    }
+}
+
+void EventLoop::spawn(Task<void> task) {
+    ready.push_back(task.getHandle());
+    spawned.push_back(std::move(task));
+}
+
+void EventLoop::run() {
+    while (true) {
+        while (!ready.empty()) {
+            std::coroutine_handle<> h = ready.front();
+            ready.pop_front();
+            h.resume();
+        }
+        if (!io->inflight() && backlog.empty()) {
+            break;
+        }
+        // 没有可以继续执行的协程时阻塞等待至少一个读完成
+        reapCompleted(true);
+    }
+    for (auto it = spawned.begin(); it != spawned.end();) {
+        if (it->done()) {
+            Task<void> task = std::move(*it);
+            it = spawned.erase(it);
+            task.result();
+        } else {
+            ++it;
+        }
+    }
+}
@@ -0,0 +1,198 @@
+#ifndef EVENTLOOP_H
+#define EVENTLOOP_H
+
+#pragma once
+
+#include <coroutine>
+#include <exception>
+#include <utility>
+#include <vector>
+#include <deque>
+#include <list>
+#include "iobackend.h"
+
+template<typename T>
+class Task;
+
+namespace detail {
+
+    //Task 的 promise 公共部分：协程结束时恢复等待它的协程，没有等待者时停下交还给事件循环
+    struct PromiseBase {
+        std::coroutine_handle<> continuation;
+        std::exception_ptr exception;
+
+        std::suspend_always initial_suspend() noexcept { return {}; }
+
+        struct FinalAwaiter {
+            bool await_ready() noexcept { return false; }
+
+            template<typename P>
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<P> h) noexcept {
+                std::coroutine_handle<> next = h.promise().continuation;
+                return next ? next : std::noop_coroutine();
+            }
+
+            void await_resume() noexcept {}
+        };
+
+        FinalAwaiter final_suspend() noexcept { return {}; }
+
+        void unhandled_exception() { exception = std::current_exception(); }
+    };
+
+    template<typename T>
+    struct Promise : PromiseBase {
+        T value{};
+
+        Task<T> get_return_object();
+
+        void return_value(T v) { value = std::move(v); }
+
+        T result() {
+            if (exception) {
+                std::rethrow_exception(exception);
+            }
+            return std::move(value);
+        }
+    };
+
+    template<>
+    struct Promise<void> : PromiseBase {
+        Task<void> get_return_object();
+
+        void return_void() {}
+
+        void result() {
+            if (exception) {
+                std::rethrow_exception(exception);
+            }
+        }
+    };
+}
+
+//惰性启动的协程：第一次被 co_await 或交给 EventLoop 时才开始执行
+template<typename T>
+class Task {
+
+public:
+    using promise_type = detail::Promise<T>;
+
+    Task() : handle(nullptr) {}
+
+    explicit Task(std::coroutine_handle<promise_type> handle) : handle(handle) {}
+
+    Task(Task &&other) noexcept : handle(std::exchange(other.handle, nullptr)) {}
+
+    Task &operator=(Task &&other) noexcept {
+        if (this != &other) {
+            if (handle) {
+                handle.destroy();
+            }
+            handle = std::exchange(other.handle, nullptr);
+        }
+        return *this;
+    }
+
+    Task(const Task &) = delete;
+
+    Task &operator=(const Task &) = delete;
+
+    ~Task() {
+        if (handle) {
+            handle.destroy();
+        }
+    }
+
+    bool done() const { return handle && handle.done(); }
+
+    //协程结束后取出结果，协程抛出的异常在这里重新抛出
+    T result() { return handle.promise().result(); }
+
+    std::coroutine_handle<> getHandle() const { return handle; }
+
+    bool await_ready() const noexcept { return false; }
+
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept {
+        handle.promise().continuation = awaiting;
+        return handle;
+    }
+
+    T await_resume() { return handle.promise().result(); }
+
+private:
+    std::coroutine_handle<promise_type> handle;
+};
+
+template<typename T>
+Task<T> detail::Promise<T>::get_return_object() {
+    return Task<T>(std::coroutine_handle<Promise<T>>::from_promise(*this));
+}
+
+inline Task<void> detail::Promise<void>::get_return_object() {
+    return Task<void>(std::coroutine_handle<Promise<void>>::from_promise(*this));
+}
+
+//单线程事件循环：协程在读请求上挂起，读完成后由 run() 恢复，一个线程可以同时挂着成千上万个查找
+class EventLoop {
+
+private:
+    //一组读请求全部完成后恢复 handle
+    struct Waiter {
+        std::coroutine_handle<> handle;
+        size_t remaining;
+    };
+
+    IOBackend *io;
+    std::deque<std::coroutine_handle<>> ready; //可以立即恢复的协程
+    std::deque<io_request *> backlog; //后端队列已满时暂存的请求
+    std::list<Task<void>> spawned; //spawn 交给事件循环持有的协程
+
+    void submit(io_request *req);
+    void reapCompleted(bool wait);
+
+public:
+    //co_await loop.readAll(reqs) 一次提交 reqs 中的所有请求，全部完成后恢复
+    class BatchAwaiter {
+    private:
+        EventLoop &loop;
+        std::vector<io_request> &reqs;
+        Waiter waiter;
+
+    public:
+        BatchAwaiter(EventLoop &loop, std::vector<io_request> &reqs) : loop(loop), reqs(reqs), waiter{nullptr, 0} {}
+
+        bool await_ready() const noexcept { return reqs.empty(); }
+
+        void await_suspend(std::coroutine_handle<> h);
+
+        void await_resume() const noexcept {}
+    };
+
+    EventLoop();
+
+    ~EventLoop();
+
+    EventLoop(const EventLoop &) = delete;
+
+    EventLoop &operator=(const EventLoop &) = delete;
+
+    BatchAwaiter readAll(std::vector<io_request> &reqs);
+
+    //把协程交给事件循环，在下一次 run() 中开始执行
+    void spawn(Task<void> task);
+
+    //恢复就绪的协程并收集完成的读请求，直到没有协程可以继续执行
+    void run();
+
+    //执行 task 直到结束并返回它的结果
+    template<typename T>
+    T runUntilComplete(Task<T> &task) {
+        ready.push_back(task.getHandle());
+        run();
+        return task.result();
+    }
+
+    const char *backendName() const;
+};
+
+#endif //EVENTLOOP_H
@@ -0,0 +1,360 @@
+#include "iobackend.h"
+#include <cstring>
+#include <cerrno>
+#include <cstdio>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+unsigned IOBackend::getDepth() const {
+    return depth;
+}
+
+IOBackend::~IOBackend() {
+    for (IOBackend *spare: spares) {
+        delete spare;
+    }
+}
+
+void IOBackend::readBatch(std::vector<io_request> &reqs) {
+    // 一个后端同一时间只服务一个提交者。本后端空闲时直接使用，否则从空闲的后端中取一个，
+    // 没有时新建一个；并发的批量读因此各自在自己的环或线程池上排队，互不等待
+    {
+        std::unique_lock<std::mutex> guard(batchLock, std::try_to_lock);
+        if (guard.owns_lock() && !broken) {
+            runBatch(reqs);
+            return;
+        }
+    }
+    IOBackend *spare;
+    {
+        std::lock_guard<std::mutex> guard(spareLock);
+        if (spares.empty()) {
+            spare = clone();
+        } else {
+            spare = spares.back();
+            spares.pop_back();
+        }
+    }
+    spare->runBatch(reqs);
+    if (spare->broken) {
+        delete spare;
+        return;
+    }
+    std::lock_guard<std::mutex> guard(spareLock);
+    spares.push_back(spare);
+}
+
+void IOBackend::runBatch(std::vector<io_request> &reqs) {
+    std::vector<io_request *> done;
+    size_t next = 0;
+    size_t finished = 0;
+    while (finished < reqs.size()) {
+        // 尽量让 depth 个请求同时在途，完成一个补一个
+        while (next < reqs.size() && inflight() < (int) depth) {
+            submit(&reqs[next++]);
+        }
+        done.clear();
+        int count = reap(done, true);
+        if (count < 0) {
+            // 后端出错时不再空转等待。内核可能还在往已提交请求的缓冲区里写，先等它们全部结束，
+            // 撤回的和还没提交的请求改用 pread 读完；本后端之后不再使用
+            broken = true;
+            done.clear();
+            drain(done);
+            for (io_request *req: done) {
+                if (req->result == -ECANCELED) {
+                    readSync(req);
+                }
+            }
+            while (next < reqs.size()) {
+                readSync(&reqs[next++]);
+            }
+            return;
+        }
+        finished += count;
+    }
+}
+
+void IOBackend::readSync(io_request *req) {
+    size_t count = 0;
+    while (count < req->len) {
+        ssize_t ret = pread(req->fd, req->buf + count, req->len - count, req->offset + count);
+        if (ret < 0 && errno == EINTR) {
+            continue;
+        }
+        if (ret <= 0) {
+            break;
+        }
+        count += ret;
+    }
+    req->result = count == req->len || count ? (ssize_t) count : -errno;
+}
+
+IOBackend *IOBackend::create(unsigned depth, int threads) {
+    UringBackend *uring = new UringBackend(depth);
+    if (uring->valid()) {
+        return uring;
+    }
+    delete uring;
+    return new ThreadPoolBackend(depth, threads);
+}
+
+UringBackend::UringBackend(unsigned depth) : IOBackend(depth), ringFd(-1), pending(0), toSubmit(0),
+                                             sqRing(MAP_FAILED), cqRing(MAP_FAILED), sqes((io_uring_sqe *) MAP_FAILED) {
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    ringFd = (int) syscall(__NR_io_uring_setup, depth, &params);
+    if (ringFd < 0) {
+        return;
+    }
+    this->depth = params.sq_entries;
+
+    sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        sqRingSize = cqRingSize = std::max(sqRingSize, cqRingSize);
+    }
+    sqRing = mmap(nullptr, sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd,
+                  IORING_OFF_SQ_RING);
+    if (sqRing == MAP_FAILED) {
+        close(ringFd);
+        ringFd = -1;
+        return;
+    }
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        cqRing = sqRing;
+    } else {
+        cqRing = mmap(nullptr, cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd,
+                      IORING_OFF_CQ_RING);
+    }
+    sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+    sqes = (struct io_uring_sqe *) mmap(nullptr, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                                        ringFd, IORING_OFF_SQES);
+    if (cqRing == MAP_FAILED || sqes == MAP_FAILED) {
+        close(ringFd);
+        ringFd = -1;
+        return;
+    }
+
+    char *sq = (char *) sqRing;
+    sqHead = (unsigned *) (sq + params.sq_off.head);
+    sqTail = (unsigned *) (sq + params.sq_off.tail);
+    sqMask = (unsigned *) (sq + params.sq_off.ring_mask);
+    sqArray = (unsigned *) (sq + params.sq_off.array);
+    char *cq = (char *) cqRing;
+    cqHead = (unsigned *) (cq + params.cq_off.head);
+    cqTail = (unsigned *) (cq + params.cq_off.tail);
+    cqMask = (unsigned *) (cq + params.cq_off.ring_mask);
+    cqes = (struct io_uring_cqe *) (cq + params.cq_off.cqes);
+}
+
+UringBackend::~UringBackend() {
+    if (sqes != MAP_FAILED) {
+        munmap(sqes, sqesSize);
+    }
+    if (cqRing != MAP_FAILED && cqRing != sqRing) {
+        munmap(cqRing, cqRingSize);
+    }
+    if (sqRing != MAP_FAILED) {
+        munmap(sqRing, sqRingSize);
+    }
+    if (ringFd >= 0) {
+        close(ringFd);
+    }
+}
+
+bool UringBackend::valid() const {
+    return ringFd >= 0;
+}
+
+int UringBackend::enter(unsigned submit, unsigned minComplete) {
+    unsigned flags = minComplete ? IORING_ENTER_GETEVENTS : 0;
+    int ret;
+    do {
+        ret = (int) syscall(__NR_io_uring_enter, ringFd, submit, minComplete, flags, nullptr, 0);
+    } while (ret < 0 && errno == EINTR);
+    if (ret < 0) {
+        perror("io_uring_enter");
+    }
+    return ret;
+}
+
+void UringBackend::submit(io_request *req) {
+    unsigned tail = *sqTail;
+    unsigned index = tail & *sqMask;
+    struct io_uring_sqe *sqe = &sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    req->iov.iov_base = req->buf;
+    req->iov.iov_len = req->len;
+    sqe->opcode = IORING_OP_READV;
+    sqe->fd = req->fd;
+    sqe->off = req->offset;
+    sqe->addr = (uint64_t) &req->iov;
+    sqe->len = 1;
+    sqe->user_data = (uint64_t) req;
+    sqArray[index] = index;
+    __atomic_store_n(sqTail, tail + 1, __ATOMIC_RELEASE);
+    toSubmit++;
+    pending++;
+}
+
+int UringBackend::reap(std::vector<io_request *> &done, bool wait) {
+    // 先把积攒的请求一次提交给内核
+    bool failed = false;
+    if (toSubmit || (wait && pending)) {
+        int ret = enter(toSubmit, wait && pending ? 1 : 0);
+        if (ret >= 0) {
+            toSubmit -= std::min((unsigned) ret, toSubmit);
+        } else {
+            failed = true;
+        }
+    }
+    int count = collect(done);
+    // io_uring_enter 失败并且没有已完成的请求时，再等也等不到，交给调用者处理
+    if (failed && wait && !count) {
+        return -1;
+    }
+    return count;
+}
+
+int UringBackend::collect(std::vector<io_request *> &done) {
+    int count = 0;
+    unsigned head = *cqHead;
+    while (head != __atomic_load_n(cqTail, __ATOMIC_ACQUIRE)) {
+        struct io_uring_cqe *cqe = &cqes[head & *cqMask];
+        io_request *req = (io_request *) cqe->user_data;
+        req->result = cqe->res;
+        done.push_back(req);
+        head++;
+        count++;
+    }
+    __atomic_store_n(cqHead, head, __ATOMIC_RELEASE);
+    pending -= count;
+    return count;
+}
+
+void UringBackend::drain(std::vector<io_request *> &done) {
+    // 提交队列中内核还没取走的条目直接撤回，内核不会再读到它们
+    unsigned head = __atomic_load_n(sqHead, __ATOMIC_ACQUIRE);
+    unsigned tail = *sqTail;
+    for (unsigned i = head; i != tail; i++) {
+        io_request *req = (io_request *) sqes[sqArray[i & *sqMask]].user_data;
+        req->result = -ECANCELED;
+        done.push_back(req);
+    }
+    __atomic_store_n(sqTail, head, __ATOMIC_RELEASE);
+    pending -= tail - head;
+    toSubmit = 0;
+    // 已经交给内核的请求还会写入它们的缓冲区，关闭环也不会等它们，必须在这里等到全部完成。
+    // io_uring_enter 已经不可用，只能轮询完成队列；每次 usleep 返回时内核会顺带执行挂在本线程上的完成工作
+    while (pending) {
+        if (!collect(done)) {
+            usleep(1000);
+        }
+    }
+}
+
+int UringBackend::inflight() const {
+    return pending;
+}
+
+const char *UringBackend::name() const {
+    return "io_uring";
+}
+
+IOBackend *UringBackend::clone() const {
+    UringBackend *uring = new UringBackend(depth);
+    if (uring->valid()) {
+        return uring;
+    }
+    delete uring;
+    return new ThreadPoolBackend(depth, 1);
+}
+
+ThreadPoolBackend::ThreadPoolBackend(unsigned depth, int threads) : IOBackend(depth), pending(0), stop(false) {
+    for (int i = 0; i < threads; i++) {
+        workers.emplace_back(&ThreadPoolBackend::work, this);
+    }
+}
+
+ThreadPoolBackend::~ThreadPoolBackend() {
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stop = true;
+    }
+    hasWork.notify_all();
+    for (auto &worker: workers) {
+        worker.join();
+    }
+}
+
+void ThreadPoolBackend::work() {
+    while (true) {
+        io_request *req;
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            hasWork.wait(guard, [this] { return stop || !queue.empty(); });
+            if (queue.empty()) {
+                return;
+            }
+            req = queue.front();
+            queue.pop_front();
+        }
+        readSync(req);
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            completed.push_back(req);
+        }
+        hasDone.notify_all();
+    }
+}
+
+void ThreadPoolBackend::submit(io_request *req) {
+    pending++;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        queue.push_back(req);
+    }
+    hasWork.notify_one();
+}
+
+int ThreadPoolBackend::reap(std::vector<io_request *> &done, bool wait) {
+    std::unique_lock<std::mutex> guard(lock);
+    if (wait && pending) {
+        hasDone.wait(guard, [this] { return !completed.empty(); });
+    }
+    int count = completed.size();
+    done.insert(done.end(), completed.begin(), completed.end());
+    completed.clear();
+    pending -= count;
+    return count;
+}
+
+void ThreadPoolBackend::drain(std::vector<io_request *> &done) {
+    std::unique_lock<std::mutex> guard(lock);
+    // 还在队列里的请求没有线程取走，直接撤回；正在读的请求等工作线程读完
+    for (io_request *req: queue) {
+        req->result = -ECANCELED;
+        done.push_back(req);
+    }
+    pending -= queue.size();
+    queue.clear();
+    hasDone.wait(guard, [this] { return (int) completed.size() == pending; });
+    done.insert(done.end(), completed.begin(), completed.end());
+    pending -= completed.size();
+    completed.clear();
+}
+
+int ThreadPoolBackend::inflight() const {
+    return pending;
+}
+
+const char *ThreadPoolBackend::name() const {
+    return "threadpool";
+}
+
+IOBackend *ThreadPoolBackend::clone() const {
+    return new ThreadPoolBackend(depth, workers.size());
+}
@@ -0,0 +1,148 @@
+#ifndef IOBACKEND_H
+#define IOBACKEND_H
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <atomic>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+struct io_request {
+    int fd; // 要读取的文件
+    off_t offset; // 读取的起始偏移量
+    size_t len; // 读取的字节数
+    char *buf; // 读到这里
+    ssize_t result; // 完成后为读到的字节数，失败时为 -errno
+    void *user; // 提交者自己的上下文，后端不使用
+    struct iovec iov; // io_uring 的 readv 使用
+};
+
+//异步读后端：一次可以提交多个读请求，同时在设备上排队
+class IOBackend {
+
+public:
+    virtual ~IOBackend();
+
+    explicit IOBackend(unsigned depth) : depth(depth), broken(false) {}
+
+    //提交一个读请求，不等待完成；请求在完成之前必须保持有效，同时在途的请求不能超过 getDepth()
+    virtual void submit(io_request *req) = 0;
+
+    //收集已完成的请求放入 done，wait 为 true 时至少等到一个完成；返回收集到的个数，后端出错、等不到完成时返回 -1
+    virtual int reap(std::vector<io_request *> &done, bool wait) = 0;
+
+    //reap 出错后调用：还没交给设备的请求撤回，result 为 -ECANCELED；已经交给设备的请求等到完成。
+    //所有在途请求都放入 done，返回时 inflight() 为 0，请求的缓冲区不再被后端引用
+    virtual void drain(std::vector<io_request *> &done) = 0;
+
+    //尚未被 reap 的请求个数
+    virtual int inflight() const = 0;
+
+    virtual const char *name() const = 0;
+
+    //创建一个同类型、同样深度的新后端
+    virtual IOBackend *clone() const = 0;
+
+    unsigned getDepth() const;
+
+    //提交一批读请求并等待全部完成，可以从多个线程调用；后端出错时剩下的请求改用 pread 读完
+    void readBatch(std::vector<io_request> &reqs);
+
+    //优先使用 io_uring，内核不支持时退回线程池
+    static IOBackend *create(unsigned depth, int threads);
+
+protected:
+    unsigned depth; //同时在途的请求数上限
+
+    //用 pread 同步读完一个请求，设置 result
+    static void readSync(io_request *req);
+
+private:
+    std::mutex batchLock; //持有它的线程独占本后端执行批量读
+    bool broken; //批量读中途出错，之后不再使用
+    std::mutex spareLock;
+    std::vector<IOBackend *> spares; //本后端忙时其他提交者使用的后端，用完放回
+
+    void runBatch(std::vector<io_request> &reqs);
+};
+
+//基于 io_uring 的实现，直接使用系统调用，不依赖 liburing
+class UringBackend : public IOBackend {
+
+private:
+    int ringFd;
+    int pending;
+    unsigned toSubmit;
+    void *sqRing;
+    void *cqRing;
+    size_t sqRingSize;
+    size_t cqRingSize;
+    struct io_uring_sqe *sqes;
+    size_t sqesSize;
+    unsigned *sqHead, *sqTail, *sqMask, *sqArray;
+    unsigned *cqHead, *cqTail, *cqMask;
+    struct io_uring_cqe *cqes;
+
+    int enter(unsigned submit, unsigned minComplete);
+    int collect(std::vector<io_request *> &done);
+
+public:
+    explicit UringBackend(unsigned depth);
+
+    ~UringBackend() override;
+
+    bool valid() const;
+
+    void submit(io_request *req) override;
+
+    int reap(std::vector<io_request *> &done, bool wait) override;
+
+    void drain(std::vector<io_request *> &done) override;
+
+    int inflight() const override;
+
+    const char *name() const override;
+
+    IOBackend *clone() const override;
+};
+
+//线程池实现：每个工作线程用 pread 完成一个请求
+class ThreadPoolBackend : public IOBackend {
+
+private:
+    std::vector<std::thread> workers;
+    std::mutex lock;
+    std::condition_variable hasWork;
+    std::condition_variable hasDone;
+    std::deque<io_request *> queue;
+    std::deque<io_request *> completed;
+    std::atomic<int> pending;
+    bool stop;
+
+    void work();
+
+public:
+    ThreadPoolBackend(unsigned depth, int threads);
+
+    ~ThreadPoolBackend() override;
+
+    void submit(io_request *req) override;
+
+    int reap(std::vector<io_request *> &done, bool wait) override;
+
+    void drain(std::vector<io_request *> &done) override;
+
+    int inflight() const override;
+
+    const char *name() const override;
+
+    IOBackend *clone() const override;
+};
+
+#endif //IOBACKEND_H
@@ -0,0 +1,110 @@
+#include "iterator.h"
+
+static std::vector<TableCursor> makeCursors(const std::vector<std::pair<uint64_t, std::string>> *mem,
+                                            const std::vector<std::pair<const SSTable *, uint64_t>> &tables) {
+    std::vector<TableCursor> cursors;
+    cursors.push_back({nullptr, mem, UINT64_MAX, 0, 1});
+    for (const auto &table: tables) {
+        cursors.push_back({table.first, nullptr, table.second, 0, 1});
+    }
+    return cursors;
+}
+
+Iterator::Iterator(const MemTable *memTable, const std::vector<std::pair<const SSTable *, uint64_t>> &tables,
+                   VLog *vlog, std::shared_lock<RWLock> lock)
+        : memTable(memTable), vlog(vlog), merger(makeCursors(&memSnapshot, tables)), fromMem(false), curSst(nullptr),
+          curPos(0), curKey(0), curOffset(0), curValueLen(0), isValid(false), versionLock(std::move(lock)) {
+}
+
+void Iterator::reposition(bool reverse, uint64_t key) {
+    // 内存表只复制 seek 方向上的部分作为快照
+    memSnapshot = reverse ? memTable->scan(0, key) : memTable->scan(key, UINT64_MAX);
+    merger.setReverse(reverse);
+    for (auto &cursor: merger.getChildren()) {
+        cursor.step = reverse ? -1 : 1;
+        if (!cursor.sst) {
+            cursor.pos = reverse ? (int) memSnapshot.size() - 1 : 0;
+            continue;
+        }
+        cursor.pos = cursor.sst->lowerBound(key);
+        // 逆序时取最后一个不大于 key 的位置
+        if (reverse && (cursor.pos == (int) cursor.sst->get_numkv() || cursor.sst->keyAt(cursor.pos) != key)) {
+            cursor.pos--;
+        }
+    }
+    merger.build();
+    findNext();
+}
+
+void Iterator::findNext() {
+    while (merger.valid()) {
+        const TableCursor &top = merger.top();
+        fromMem = !top.sst;
+        curSst = top.sst;
+        curPos = top.pos;
+        curKey = merger.key();
+        curValueLen = top.valueLen();
+        curOffset = fromMem ? top.pos : top.offset();
+        // 同一个键的较旧版本直接跳过
+        merger.next();
+        while (merger.valid() && merger.key() == curKey) {
+            merger.next();
+        }
+        if (curValueLen) {
+            isValid = true;
+            return;
+        }
+    }
+    isValid = false;
+}
+
+void Iterator::seek(uint64_t key) {
+    reposition(false, key);
+}
+
+void Iterator::seekToFirst() {
+    seek(0);
+}
+
+void Iterator::seekForPrev(uint64_t key) {
+    reposition(true, key);
+}
+
+void Iterator::seekToLast() {
+    seekForPrev(UINT64_MAX);
+}
+
+bool Iterator::valid() const {
+    return isValid;
+}
+
+void Iterator::next() {
+    findNext();
+}
+
+void Iterator::prev() {
+    findNext();
+}
+
+uint64_t Iterator::key() const {
+    return curKey;
+}
+
+std::string Iterator::value() const {
+    if (fromMem) {
+        return memSnapshot[curOffset].second;
+    }
+    if (curValueLen & INLINE_FLAG) {
+        return curSst->inlineValueAt(curPos);
+    }
+    return vlog->readValue(curOffset, curValueLen);
+}
+
+bool Iterator::location(uint64_t &offset, uint64_t &valueLen) const {
+    if (fromMem || (curValueLen & INLINE_FLAG)) {
+        return false;
+    }
+    offset = curOffset;
+    valueLen = curValueLen;
+    return true;
+}
@@ -0,0 +1,108 @@
+#ifndef ITERATOR_H
+#define ITERATOR_H
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <shared_mutex>
+#include "rwlock.h"
+#include "config.h"
+#include "memtable.h"
+#include "sstable.h"
+#include "vlog.h"
+#include "mergingiterator.h"
+
+//SSTable 或内存表快照上的游标，作为 MergingIterator 的子迭代器；step 为 -1 时逆序移动
+struct TableCursor {
+    const SSTable *sst; //为空时遍历 mem
+    const std::vector<std::pair<uint64_t, std::string>> *mem;
+    uint64_t rank; //同一个键优先级高的版本更新
+    int pos;
+    int step;
+
+    bool valid() const {
+        return pos >= 0 && pos < (sst ? (int) sst->get_numkv() : (int) mem->size());
+    }
+
+    void next() {
+        pos += step;
+    }
+
+    uint64_t key() const {
+        return sst ? sst->keyAt(pos) : (*mem)[pos].first;
+    }
+
+    uint64_t priority() const {
+        return rank;
+    }
+
+    //值的长度，删除标记为 0
+    uint64_t valueLen() const {
+        if (sst) {
+            return sst->valueLenAt(pos);
+        }
+        return (*mem)[pos].second == "~DELETED~" ? 0 : (*mem)[pos].second.size();
+    }
+
+    uint64_t offset() const {
+        return sst ? sst->offsetAt(pos) : 0;
+    }
+};
+
+//按键的顺序（seekForPrev 之后按逆序）流式遍历整个 KVStore：用败者树合并内存表和各个 SSTable 的游标，同一个键只取最新的版本并跳过已删除的键。
+//只有调用 value() 时才读取 vlog。内存表在 seek 时复制一份快照；迭代器持有 KVStore 的共享锁，
+//存活期间写入会阻塞，同一个线程在迭代期间写入会死锁
+class Iterator {
+
+private:
+    const MemTable *memTable;
+    VLog *vlog;
+    std::vector<std::pair<uint64_t, std::string>> memSnapshot;
+    MergingIterator<TableCursor> merger; //第 0 个子迭代器是内存表快照
+    bool fromMem; //当前条目来自内存表快照
+    const SSTable *curSst; //当前条目所在的 SSTable 和下标，用于读取内联的值
+    int curPos;
+    uint64_t curKey;
+    uint64_t curOffset; //来自内存表时是快照中的下标
+    uint64_t curValueLen;
+    bool isValid;
+    std::shared_lock<RWLock> versionLock; //迭代器存活期间持有，阻止转储和合并结果安装
+
+    void reposition(bool reverse, uint64_t key);
+    void findNext();
+
+public:
+    //tables 是参与合并的 SSTable 和它们的优先级，内存表的优先级最高；lock 是收集 tables 时持有的共享锁，迭代器接管它直到析构
+    Iterator(const MemTable *memTable, const std::vector<std::pair<const SSTable *, uint64_t>> &tables, VLog *vlog,
+             std::shared_lock<RWLock> lock = std::shared_lock<RWLock>());
+
+    //定位到第一个不小于 key 的键
+    void seek(uint64_t key);
+
+    void seekToFirst();
+
+    //定位到最后一个不大于 key 的键，之后用 prev() 逆序遍历
+    void seekForPrev(uint64_t key);
+
+    void seekToLast();
+
+    bool valid() const;
+
+    //移动到下一个键，必须在 seek 之后调用
+    void next();
+
+    //移动到上一个键，必须在 seekForPrev 之后调用
+    void prev();
+
+    uint64_t key() const;
+
+    //读取当前键的值，值在 vlog 中时这里才发生读取
+    std::string value() const;
+
+    //值在 vlog 中时返回 true 并给出偏移量和长度，值在内存表中或内联在 SSTable 中时返回 false
+    bool location(uint64_t &offset, uint64_t &valueLen) const;
+};
+
+#endif //ITERATOR_H
@@ -3,64 +3,394 @@
 #include <fcntl.h>
 #include <queue>
 #include <cassert>
+#include <algorithm>
 #include "kvstore_utils.hpp"
 
 
-KVStore::KVStore(const std::string &dir, const std::string &vlog) : KVStoreAPI(dir, vlog) {
+KVStore::KVStore(const std::string &dir, const std::string &vlog, compaction_style style) : KVStoreAPI(dir, vlog) {
     this->memTable = new MemTable(0.5, BLOOMSIZE);
     this->dir_path = dir;
-    this->vlog_path = vlog;
     this->stamp = 0;
-    this->head = 0;
     this->tail = 0;
     this->bloomSize = BLOOMSIZE;
+    this->style = style;
+    this->fifoMaxBytes = FIFO_MAX_BYTES;
+    this->fifoTtlSeconds = FIFO_TTL_SECONDS;
+    this->hashIndex = SST_HASH_INDEX;
+    // 切出的范围数超过核数时各个线程只是轮流执行，默认不超过核数，单核时不切分
+    this->subcompactions = std::min((unsigned) SUBCOMPACTIONS, std::max(1u, std::thread::hardware_concurrency()));
+    this->userBytes = 0;
+    this->flushBytes = 0;
+    if (!utils::dirExists(dir_path)) {
+        utils::mkdir(dir_path);
+    }
+    this->cache = new ValueCache(VALUECACHE_CAPACITY, VALUECACHE_SHARD_BITS);
+    this->io = IOBackend::create(IO_QUEUE_DEPTH, IO_THREADS);
+    this->vlog = new VLog(vlog, cache, io);
+    this->rateLimiter = new RateLimiter(RATE_LIMIT_BYTES_PER_SEC);
     std::priority_queue <sst_info> sstables;
     std::vector <std::string> files;
     utils::scanDir(dir_path, files);
     process_vlog();
     process_sst(files, sstables);
     write_sst(sstables);
+    // 恢复出来的第 0 层可能已经超过阈值，启动后台线程后立即检查一次
+    this->compactPending = false;
+    this->fifoTimer = false;
+    this->seekCandidate = nullptr;
+    this->seekLevel = 0;
+    this->compactStats = compaction_stats{};
+    this->stopCompactor = false;
+    this->compactor = std::thread(&KVStore::backgroundCompaction, this);
+    scheduleCompaction();
 }
 
 KVStore::~KVStore() {
+    //先停下后台合并，之后不会再有线程访问 layers
+    stopBackgroundCompaction();
     //检查内存中的跳表 memTable 是否包含键值对
     if (memTable->get_numkv()) {
         //将 memTable 转换为 SSTable 并添加到第 0 层
-        layers[0].push_back(memTable->convertSSTable(layers[0].size(), stamp++, dir_path, vlog_path));
+        layers[0].push_back(memTable->convertSSTable(nextTableId(0), stamp++, dir_path, vlog, hashIndex));
     }
     //释放 memTable 占用的内存
     delete memTable;
+    delete vlog;
+    delete rateLimiter;
+    delete io;
+    delete cache;
 }
 
 void KVStore::checkAndConvertMemTable() {
     if (isMemTableFull()) {
-        layers[0].push_back(memTable->convertSSTable(layers[0].size(), stamp++, dir_path, vlog_path));
-        delete memTable;
-        memTable = new MemTable(0.5, bloomSize);
+        convertMemTableToSSTable();
+    }
+}
+
+uint64_t KVStore::levelBytes(int level) const {
+    uint64_t bytes = 0;
+    for (const auto &sst: layers[level]) {
+        bytes += sst->diskSize();
+    }
+    return bytes;
+}
+
+uint64_t KVStore::levelTargetBytes(int level) const {
+    uint64_t target = LEVEL_BASE_BYTES;
+    for (int i = 1; i < level; i++) {
+        target *= LEVEL_MULTIPLIER;
+    }
+    return target;
+}
+
+double KVStore::compactionScore(int level) const {
+    // 第 0 层的文件互相重叠，每个文件都会增加点查的探测次数，按文件数计分；其余层按字节数与目标之比计分
+    if (level == 0) {
+        return (double) layers[0].size() / L0_COMPACTION_TRIGGER;
+    }
+    // 分层合并不看字节数，本层的有序段数达到 TIER_RUNS 才合并
+    if (style == TIERED_COMPACTION) {
+        return (double) countRuns(level) / TIER_RUNS;
+    }
+    return (double) levelBytes(level) / levelTargetBytes(level);
+}
+
+int KVStore::pickInputFile(int level) const {
+    // 选与下一层重叠字节数相对自身大小最小的文件，推下去时重写的下一层数据最少
+    int best = 0;
+    double bestRatio = -1;
+    size_t j = 0;
+    static const std::vector<SSTable *> empty;
+    const std::vector<SSTable *> &next = level + 1 < (int) layers.size() ? layers[level + 1] : empty;
+    for (size_t i = 0; i < layers[level].size(); i++) {
+        const SSTable *sst = layers[level][i];
+        // 两层都按键有序且互不重叠，下一层的起点只会向后移动
+        while (j < next.size() && next[j]->get_maxkey() < sst->get_minkey()) {
+            j++;
+        }
+        uint64_t overlap = 0;
+        for (size_t k = j; k < next.size() && next[k]->get_minkey() <= sst->get_maxkey(); k++) {
+            overlap += next[k]->diskSize();
+        }
+        double ratio = (double) overlap / sst->diskSize();
+        if (bestRatio < 0 || ratio < bestRatio) {
+            bestRatio = ratio;
+            best = i;
+        }
+    }
+    return best;
+}
+
+bool KVStore::isTrivialMove(const compaction_job &job) const {
+    // 分层合并要把多个段合成一个，不做移动；下一层有重叠时必须归并
+    if (style == TIERED_COMPACTION || !job.index.empty()) {
+        return false;
+    }
+    // 第 0 层的多个输入之间也不能重叠（顺序写入时通常如此），移下去之后下一层仍然互不重叠
+    std::vector<SSTable *> upper = job.upper;
+    std::sort(upper.begin(), upper.end(), [](const SSTable *a, const SSTable *b) {
+        return a->get_minkey() < b->get_minkey();
+    });
+    for (size_t i = 1; i < upper.size(); i++) {
+        if (upper[i - 1]->get_maxkey() >= upper[i]->get_minkey()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void KVStore::recordWastedProbe(int level, const SSTable *sst) {
+    // 调用者持有 versionLock；次数达到阈值并且没有等待合并的候选时才通知，已经有候选时不替换
+    if (!SEEK_COMPACTION_TRIGGER || sst->addWastedProbe() < SEEK_COMPACTION_TRIGGER) {
+        return;
+    }
+    std::lock_guard<std::mutex> guard(compactMutex);
+    if (!seekCandidate) {
+        seekCandidate = sst;
+        seekLevel = level;
+        compactPending = true;
+        compactCond.notify_one();
+    }
+}
+
+int KVStore::pickSeekCompaction(int &index) {
+    // 调用者持有 versionLock 的独占锁。删除 SSTable 时会清掉指向它的候选，这里的指针总是有效的；
+    // 候选可能已经被原样移到下一层，按指针在记录的层中重新查找
+    const SSTable *sst;
+    int level;
+    {
+        std::lock_guard<std::mutex> guard(compactMutex);
+        sst = seekCandidate;
+        level = seekLevel;
+        seekCandidate = nullptr;
+    }
+    if (!sst || level >= (int) layers.size()) {
+        return -1;
+    }
+    index = std::find(layers[level].begin(), layers[level].end(), sst) - layers[level].begin();
+    if (index == (int) layers[level].size()) {
+        return -1;
+    }
+    // 更深的层都是空的，移下去之后它仍然是最后被探测的那个，合并没有意义；清零计数，避免每次探测都再唤醒后台线程
+    for (int deeper = level + 1; deeper < (int) layers.size(); deeper++) {
+        if (!layers[deeper].empty()) {
+            return level;
+        }
+    }
+    sst->resetWastedProbes();
+    return -1;
+}
+
+void KVStore::forgetSeekCandidate(const SSTable *sst) {
+    // 调用者持有 versionLock 的独占锁，在释放 sst 之前调用，候选不会指向已经释放的内存
+    std::lock_guard<std::mutex> guard(compactMutex);
+    if (seekCandidate == sst) {
+        seekCandidate = nullptr;
     }
 }
 
-bool KVStore::needCompaction(int level) const {
-    constexpr int COMPACTION_THRESHOLD_FACTOR = 4; // 替代 (1 << 2)
-    int threshold = (1 << (level + 2)); // 计算当前层的阈值
-    return layers[level].size() > threshold;
+bool KVStore::overlapping(int level) const {
+    // 第 0 层的每个文件、分层合并时每层的每个有序段都可能与同层其他文件重叠；
+    // FIFO 合并只在打开已有目录时才会有第 1 层及以下，按重叠处理总是安全的
+    return level == 0 || style != LEVELED_COMPACTION;
 }
 
-void KVStore::doCompaction() {
-    for (int i = 0; i < layers.size(); ++i) {
-        if (needCompaction(i)) {
-            compaction(i);
+uint64_t KVStore::fifoBytes() const {
+    uint64_t bytes = vlog->end() - tail;
+    for (const auto &layer: layers) {
+        for (const auto &sst: layer) {
+            bytes += sst->diskSize();
+        }
+    }
+    return bytes;
+}
+
+uint64_t KVStore::expireFifoTables() {
+    // 调用者持有 versionLock 的独占锁。按时间戳从旧到新删除 SSTable，直到不超过大小和时间限制；
+    // 每删除一个就把 vlog 的 tail 推进到剩余 SSTable 引用的最小偏移量，回收之前的空间
+    uint64_t expired = 0;
+    time_t now = time(nullptr);
+    while (true) {
+        int level = -1, index = -1;
+        for (int i = 0; i < (int) layers.size(); i++) {
+            for (int j = 0; j < (int) layers[i].size(); j++) {
+                if (level == -1 || layers[i][j]->getStamp() < layers[level][index]->getStamp()) {
+                    level = i;
+                    index = j;
+                }
+            }
+        }
+        if (level == -1) {
+            break;
+        }
+        SSTable *oldest = layers[level][index];
+        bool overSize = fifoMaxBytes && fifoBytes() > fifoMaxBytes;
+        bool overAge = fifoTtlSeconds && now - oldest->modifiedTime() > (time_t) fifoTtlSeconds;
+        if (!overSize && !overAge) {
+            break;
+        }
+        // 只摘下这一个文件，其余文件不改名：编号只增不减，第 0 层按时间戳而不是编号排列
+        oldest->delete_disk();
+        forgetSeekCandidate(oldest);
+        delete oldest;
+        layers[level].erase(layers[level].begin() + index);
+        rebuildFences(level);
+        expired++;
+
+        // 内存表中的值还没有写入 vlog，剩余的 SSTable 都不引用 vlog 时可以回收到末尾
+        uint64_t begin = vlog->end();
+        for (const auto &layer: layers) {
+            for (const auto &sst: layer) {
+                begin = std::min(begin, sst->getVlogBegin());
+            }
+        }
+        if (begin > tail) {
+            vlog->punchHole(tail, begin - tail);
+            tail = begin;
+        }
+    }
+    return expired;
+}
+
+int KVStore::countRuns(int level) const {
+    // 第 0 层每个文件是一个段；其余层同一个段的文件时间戳相同且排在一起
+    if (level == 0) {
+        return layers[0].size();
+    }
+    int runs = 0;
+    for (int i = 0; i < (int) layers[level].size(); i++) {
+        if (i == 0 || layers[level][i]->getStamp() != layers[level][i - 1]->getStamp()) {
+            runs++;
+        }
+    }
+    return runs;
+}
+
+int KVStore::oldestRunsEnd(int level, int runs) const {
+    // 返回最旧的 runs 个段之后第一个文件的下标，这些段正好是本层的前缀
+    int i = 0;
+    while (i < (int) layers[level].size() && runs > 0) {
+        uint64_t runStamp = layers[level][i]->getStamp();
+        while (i < (int) layers[level].size() && layers[level][i]->getStamp() == runStamp) {
+            i++;
+        }
+        runs--;
+    }
+    return i;
+}
+
+void KVStore::scheduleCompaction() {
+    // 调用者持有 versionLock 的独占锁或者处在构造过程中
+    std::lock_guard<std::mutex> guard(compactMutex);
+    // FIFO 合并时第 0 层就是全部数据，文件数不代表合并落后，不限速
+    level0Files = style == FIFO_COMPACTION ? 0 : layers[0].size();
+    fifoTimer = style == FIFO_COMPACTION && fifoTtlSeconds;
+    compactPending = true;
+    compactCond.notify_one();
+}
+
+void KVStore::backgroundCompaction() {
+    std::unique_lock<std::mutex> lock(compactMutex);
+    while (true) {
+        if (fifoTimer) {
+            // 没有写入时过期的 SSTable 也要按时删除
+            compactCond.wait_for(lock, std::chrono::milliseconds(FIFO_CHECK_INTERVAL_MS),
+                                 [this] { return compactPending || stopCompactor; });
+        } else {
+            compactCond.wait(lock, [this] { return compactPending || stopCompactor; });
+        }
+        if (stopCompactor) {
+            return;
+        }
+        compactPending = false;
+        lock.unlock();
+        runCompactions();
+        lock.lock();
+    }
+}
+
+void KVStore::runCompactions() {
+    std::lock_guard<std::mutex> guard(compactionLock);
+    if (style == FIFO_COMPACTION) {
+        // 从不合并，只删除超出限制的旧 SSTable
+        uint64_t expired;
+        {
+            std::unique_lock<RWLock> lock(versionLock);
+            expired = expireFifoTables();
+        }
+        std::lock_guard<std::mutex> stateGuard(compactMutex);
+        compactStats.expired_files += expired;
+        return;
+    }
+    compaction_job job;
+    while (!stopCompactor) {
+        {
+            std::unique_lock<RWLock> lock(versionLock);
+            if (!pickCompaction(job)) {
+                break;
+            }
+        }
+        // 归并和写出新文件期间不持有 versionLock，前台的读写继续使用旧的 SSTable
+        if (!job.trivial) {
+            mergeAndWriteSSTables(job);
         }
+        size_t files;
+        {
+            std::unique_lock<RWLock> lock(versionLock);
+            installCompaction(job);
+            files = layers[0].size();
+        }
+        std::lock_guard<std::mutex> stateGuard(compactMutex);
+        level0Files = files;
+        compactStats.compactions += !job.trivial;
+        compactStats.input_files += job.stats.input_files;
+        compactStats.output_files += job.stats.output_files;
+        compactStats.input_entries += job.stats.input_entries;
+        compactStats.output_entries += job.stats.output_entries;
+        compactStats.dropped_versions += job.stats.dropped_versions;
+        compactStats.dropped_tombstones += job.stats.dropped_tombstones;
+        compactStats.bytes_written += job.stats.bytes_written;
+        compactStats.trivial_moves += job.stats.trivial_moves;
+        compactStats.seek_compactions += job.stats.seek_compactions;
+        compactStats.subcompactions += job.stats.subcompactions;
+        stallCond.notify_all();
     }
 }
 
+void KVStore::stopBackgroundCompaction() {
+    {
+        std::lock_guard<std::mutex> guard(compactMutex);
+        stopCompactor = true;
+        compactCond.notify_one();
+        stallCond.notify_all();
+    }
+    // 正在进行的合并不再限速，尽快写完退出
+    rateLimiter->setBytesPerSecond(0);
+    if (compactor.joinable()) {
+        compactor.join();
+    }
+}
+
+void KVStore::throttleWrites() {
+    // 第 0 层堆积过多时读放大迅速上升，让写入等后台合并追上
+    std::unique_lock<std::mutex> lock(compactMutex);
+    stallCond.wait(lock, [this] { return level0Files <= L0_STOP_TRIGGER || stopCompactor; });
+}
+
 /**
  * Insert/Update the key-value pair.
  * No return values for simplicity.
  */
 void KVStore::put(uint64_t key, const std::string &s) {
+    throttleWrites();
+    std::unique_lock<RWLock> lock(versionLock);
+    userBytes += sizeof(key) + s.size();
+    putValue(key, s);
+}
+
+void KVStore::putValue(uint64_t key, const std::string &s) {
+    // 调用者持有 versionLock 的独占锁；内存表写满时转储，合并交给后台线程
     checkAndConvertMemTable();
-    doCompaction();
     memTable->put(key, s);
 }
 
@@ -74,28 +404,60 @@ std::string KVStore::getValueFromMemTable(uint64_t key) {
     return "";
 }
 
-std::string KVStore::getValueFromSSTable(uint64_t key) {
+std::string KVStore::getValueFromSSTable(uint64_t key, const bloomHash &h) {
     std::string val = "";
-    for (const auto &layer: layers) {
-        for (auto it = layer.rbegin(); it != layer.rend(); ++it) {
-            if ((*it)->query(key)) {
-                val = (*it)->get(key);
-                if (val == "~DELETED~") {
-                    return "";
-                } else if (val != "") {
-                    return val;
+    std::vector<char> hits;
+    for (int i = 0; i < (int) layers.size(); ++i) {
+        if (overlapping(i)) {
+            // 文件互相重叠的层用同一组哈希值一次性批量探测过滤器，再从新到旧读取候选 SSTable
+            queryLayer(i, h, hits);
+            for (int j = (int) layers[i].size() - 1; j >= 0; --j) {
+                if (hits[j]) {
+                    val = layers[i][j]->get(key);
+                    if (val == "~DELETED~") {
+                        return "";
+                    } else if (val != "") {
+                        return val;
+                    }
+                    recordWastedProbe(i, layers[i][j]);
                 }
             }
+            continue;
+        }
+        // 互不重叠的层最多只有一个候选 SSTable，先用栅栏索引定位再探测过滤器
+        int j = findTable(i, key);
+        if (j != -1 && layers[i][j]->query(h)) {
+            val = layers[i][j]->get(key);
+            if (val == "~DELETED~") {
+                return "";
+            } else if (val != "") {
+                return val;
+            }
+            recordWastedProbe(i, layers[i][j]);
         }
     }
     return "";
 }
 
+void KVStore::queryLayer(int level, const bloomHash &h, std::vector<char> &hits) const {
+    std::vector<const bloomFilter *> filters;
+    filters.reserve(layers[level].size());
+    for (const auto &sst: layers[level]) {
+        filters.push_back(sst->getFilter());
+    }
+    bloomFilter::queryBatch(filters, h, hits);
+}
+
 /**
  * Returns the (string) value of the given key.
  * An empty string indicates not found.
  */
 std::string KVStore::get(uint64_t key) {
+    std::shared_lock<RWLock> lock(versionLock);
+    return getValue(key);
+}
+
+std::string KVStore::getValue(uint64_t key) {
     // 从内存中的跳表 memTable 获取值
     std::string val = memTable->get(key);
     if (val == "~DELETED~") {
@@ -103,33 +465,138 @@ std::string KVStore::get(uint64_t key) {
     } else if (val != "") {
         return val;
     }
-    // 从 SSTable 获取值
-    for (auto &layer : layers) {
-        // 从后向前遍历每层 SSTable
-        for (auto it = layer.rbegin(); it != layer.rend(); ++it) {
-            // 如果测试模式为 1 或 2，或者布隆过滤器判断键可能存在于 SSTable 中，则继续获取值
-            if ((*it)->query(key)) {
-                // 从 SSTable 中获取值
-                val = (*it)->get(key);
-                if (val == "~DELETED~") {
-                    return "";
-                } else if (val != "") {
-                    return val;
+    // 从 SSTable 获取值，整个查找过程只计算一次键的哈希
+    return getValueFromSSTable(key, bloomFilter::hash(key, BLOOMHASHNUM));
+}
+
+
+/**
+ * Looks up the given key without copying its value.
+ * Returns false iff the key is not found.
+ */
+bool KVStore::get(uint64_t key, ValueHandle &value) {
+    value.reset();
+    std::shared_lock<RWLock> lock(versionLock);
+    std::string val = memTable->get(key);
+    if (val == "~DELETED~") {
+        return false;
+    } else if (val != "") {
+        // 内存表中的值随时可能被覆盖，只能复制一份交给句柄持有
+        std::shared_ptr<const std::string> copy = std::make_shared<const std::string>(std::move(val));
+        value = ValueHandle(copy, copy->data(), copy->size());
+        return true;
+    }
+    uint64_t offset, valueLen;
+    std::string inlineValue;
+    if (!locateInSSTables(key, offset, valueLen, &inlineValue) || !valueLen) {
+        return false;
+    }
+    if (valueLen & INLINE_FLAG) {
+        std::shared_ptr<const std::string> copy = std::make_shared<const std::string>(std::move(inlineValue));
+        value = ValueHandle(copy, copy->data(), copy->size());
+        return true;
+    }
+    return vlog->readValue(offset, valueLen, value);
+}
+
+/**
+ * Returns the values of all given keys, in the same order as keys.
+ * An empty string indicates not found.
+ */
+std::vector<std::string> KVStore::multiGet(const std::vector<uint64_t> &keys) {
+    std::vector<std::string> vals(keys.size());
+    std::shared_lock<RWLock> lock(versionLock);
+    // 按键排序后去重，每个不同的键只查找一次
+    std::vector<int> order(keys.size());
+    for (size_t i = 0; i < keys.size(); i++) {
+        order[i] = i;
+    }
+    std::sort(order.begin(), order.end(), [&keys](int a, int b) {
+        return keys[a] < keys[b];
+    });
+    std::vector<uint64_t> sorted;
+    std::vector<int> first;
+    for (int i: order) {
+        if (sorted.empty() || sorted.back() != keys[i]) {
+            sorted.push_back(keys[i]);
+            first.push_back(i);
+        }
+    }
+
+    // 内存表中按升序一次走完
+    std::vector<std::string> memVals;
+    memTable->get(sorted, memVals);
+    std::vector<char> resolved(sorted.size(), 0);
+    std::vector<bloomHash> hashes(sorted.size());
+    for (size_t i = 0; i < sorted.size(); i++) {
+        if (memVals[i] != "") {
+            resolved[i] = 1;
+            vals[first[i]] = memVals[i] == "~DELETED~" ? "" : memVals[i];
+        } else {
+            hashes[i] = bloomFilter::hash(sorted[i], BLOOMHASHNUM);
+        }
+    }
+
+    // 逐层查找剩余的键，只查 SSTable 的索引，把需要读取的值记下来最后统一读 vlog
+    std::vector<vlog_read> reads;
+    std::vector<char> hits;
+    uint64_t offset, valueLen;
+    std::string inlineValue;
+    for (size_t level = 0; level < layers.size(); level++) {
+        size_t j = 0;
+        for (size_t i = 0; i < sorted.size(); i++) {
+            if (resolved[i]) {
+                continue;
+            }
+            if (overlapping(level)) {
+                queryLayer(level, hashes[i], hits);
+                for (int t = (int) layers[level].size() - 1; t >= 0; --t) {
+                    if (hits[t] && layers[level][t]->locate(sorted[i], offset, valueLen, &inlineValue)) {
+                        resolved[i] = 1;
+                        break;
+                    }
+                }
+            } else {
+                // 键升序且本层互不重叠，候选 SSTable 的位置只会向后移动
+                while (j < fences[level].size() && fences[level][j].max_key < sorted[i]) {
+                    j++;
+                }
+                if (j == fences[level].size()) {
+                    break;
+                }
+                if (fences[level][j].min_key <= sorted[i] && layers[level][j]->query(hashes[i]) &&
+                    layers[level][j]->locate(sorted[i], offset, valueLen, &inlineValue)) {
+                    resolved[i] = 1;
                 }
             }
+            if (resolved[i] && (valueLen & INLINE_FLAG)) {
+                vals[first[i]] = inlineValue;
+            } else if (resolved[i] && valueLen) {
+                reads.push_back(vlog_read{(off_t) offset, valueLen, first[i]});
+            }
         }
     }
-    return "";
-}
+    vlog->readValues(reads, vals);
 
+    // 重复的键直接复制第一次出现时的结果
+    for (size_t i = 1; i < order.size(); i++) {
+        if (keys[order[i]] == keys[order[i - 1]]) {
+            vals[order[i]] = vals[order[i - 1]];
+        }
+    }
+    return vals;
+}
 
 /**
  * Delete the given key-value pair if it exists.
  * Returns false iff the key is not found.
  */
 bool KVStore::del(uint64_t key) {
-    if (get(key) != "") {
-        put(key, "~DELETED~");
+    throttleWrites();
+    std::unique_lock<RWLock> lock(versionLock);
+    if (getValue(key) != "") {
+        userBytes += sizeof(key);
+        putValue(key, "~DELETED~");
         return true;
     }
     return false;
@@ -143,6 +610,9 @@ void KVStore::deleteAllSSTables() {
             layer.pop_back();
         }
     }
+    for (auto &f: fences) {
+        f.clear();
+    }
 }
 
 void KVStore::deleteAllFilesInDir() {
@@ -158,11 +628,19 @@ void KVStore::deleteAllFilesInDir() {
  * including memtable and all sstables files.
  */
 void KVStore::reset() {
+    // 等正在进行的合并安装完毕，之后后台线程选不出任何工作
+    std::lock_guard<std::mutex> guard(compactionLock);
+    std::unique_lock<RWLock> lock(versionLock);
     deleteAllSSTables();
     delete memTable;
-    utils::rmfile(vlog_path);
+    vlog->reset();
+    tail = 0;
     deleteAllFilesInDir();
     memTable = new MemTable(0.5, bloomSize);
+    std::lock_guard<std::mutex> stateGuard(compactMutex);
+    seekCandidate = nullptr;
+    level0Files = 0;
+    stallCond.notify_all();
 }
 
 /**
@@ -171,18 +649,225 @@ void KVStore::reset() {
  * An empty string indicates not found.
  */
 void KVStore::scan(uint64_t key1, uint64_t key2, std::list <std::pair<uint64_t, std::string>> &list) {
-    std::priority_queue <kv> kvs;
-    std::vector < std::vector < std::pair < uint64_t, std::string>>> scanRes;
-    std::vector<int> it;
-    getPairsFromMemTable(key1, key2, scanRes, it, kvs);
-    getPairsFromSSTable(key1, key2, scanRes, it, kvs);
-    removeDeletedPairs(list, scanRes, it, kvs);
+    scan(key1, key2, SIZE_MAX, false, list);
+}
+
+void KVStore::collectRange(uint64_t key1, uint64_t key2, size_t limit, bool reverse, std::vector<uint64_t> &keys,
+                           std::vector<vlog_read> &reads, std::vector<std::string> &vals) {
+    // 迭代器只合并键和值的位置，需要从 vlog 读取的值记入 reads，由调用者一起读出；凑够 limit 个键就停止合并。
+    // 调用者持有 versionLock
+    Iterator *iter = createIterator();
+    uint64_t offset, valueLen;
+    if (reverse) {
+        iter->seekForPrev(key2);
+    } else {
+        iter->seek(key1);
+    }
+    for (; keys.size() < limit && iter->valid() && (reverse ? iter->key() >= key1 : iter->key() <= key2);
+           reverse ? iter->prev() : iter->next()) {
+        if (iter->location(offset, valueLen)) {
+            reads.push_back({(off_t) offset, valueLen, (int) vals.size()});
+            vals.emplace_back();
+        } else {
+            vals.push_back(iter->value());
+        }
+        keys.push_back(iter->key());
+    }
+    delete iter;
+}
+
+/**
+ * Scans at most limit live keys in [key1, key2], from key1 upwards or, when
+ * reverse is true, from key2 downwards. Only the returned values are read
+ * from the vlog.
+ */
+void KVStore::scan(uint64_t key1, uint64_t key2, size_t limit, bool reverse,
+                   std::list <std::pair<uint64_t, std::string>> &list) {
+    if (key1 > key2) {
+        return;
+    }
+    std::vector<uint64_t> keys;
+    std::vector<vlog_read> reads;
+    std::vector<std::string> vals;
+    std::shared_lock<RWLock> lock(versionLock);
+    collectRange(key1, key2, limit, reverse, keys, reads, vals);
+    // 一次转储写出的值在 vlog 中按键相邻，排序合并后大范围扫描基本是顺序读
+    vlog->readValues(reads, vals);
+    for (size_t i = 0; i < keys.size(); ++i) {
+        list.push_back(std::make_pair(keys[i], std::move(vals[i])));
+    }
+}
+
+/**
+ * Returns the live keys in [key1, key2] in order. Tombstones and newer
+ * versions are resolved from the in-memory indexes; no value is read.
+ */
+std::vector<uint64_t> KVStore::scanKeys(uint64_t key1, uint64_t key2) {
+    std::vector<uint64_t> keys;
+    if (key1 > key2) {
+        return keys;
+    }
+    Iterator *iter = newIterator();
+    for (iter->seek(key1); iter->valid() && iter->key() <= key2; iter->next()) {
+        keys.push_back(iter->key());
+    }
+    delete iter;
+    return keys;
+}
+
+/**
+ * Counts the live keys in [key1, key2] exactly, without reading the vlog.
+ */
+uint64_t KVStore::countRange(uint64_t key1, uint64_t key2) {
+    uint64_t count = 0;
+    if (key1 > key2) {
+        return 0;
+    }
+    Iterator *iter = newIterator();
+    for (iter->seek(key1); iter->valid() && iter->key() <= key2; iter->next()) {
+        count++;
+    }
+    delete iter;
+    return count;
+}
+
+/**
+ * Estimates the entries and bytes stored for [key1, key2] from the SSTable
+ * indexes and the memtable. Old versions and tombstones are counted too, so
+ * this is an upper bound on what a scan would return.
+ */
+range_size KVStore::approximateSize(uint64_t key1, uint64_t key2) {
+    range_size size{0, 0};
+    if (key1 > key2) {
+        return size;
+    }
+    std::shared_lock<RWLock> lock(versionLock);
+    for (const auto &pair: memTable->scan(key1, key2)) {
+        size.keys++;
+        size.bytes += KOVSIZE + VLOGPADDING + pair.second.size();
+    }
+    for (const auto &layer: layers) {
+        for (const auto &sst: layer) {
+            if (sst->get_maxkey() < key1 || sst->get_minkey() > key2) {
+                continue;
+            }
+            for (int i = sst->lowerBound(key1); i < (int) sst->get_numkv() && sst->keyAt(i) <= key2; ++i) {
+                size.keys++;
+                uint64_t valueLen = sst->valueLenAt(i);
+                if (valueLen & INLINE_FLAG) {
+                    size.bytes += KOVSIZE + (valueLen & ~INLINE_FLAG);
+                } else {
+                    size.bytes += KOVSIZE + (valueLen ? VLOGPADDING + valueLen : 0);
+                }
+            }
+        }
+    }
+    return size;
+}
+
+/**
+ * Returns an iterator over the whole store; the caller deletes it.
+ * The iterator holds a read lock until it is deleted: writes from other
+ * threads wait for it, and a write from the iterating thread deadlocks.
+ */
+Iterator *KVStore::newIterator() {
+    return createIterator(std::shared_lock<RWLock>(versionLock));
+}
+
+Iterator *KVStore::createIterator(std::shared_lock<RWLock> lock) {
+    // 没有传入锁时由调用者持有 versionLock
+    std::vector<std::pair<const SSTable *, uint64_t>> tables;
+    for (int level = 0; level < (int) layers.size(); ++level) {
+        for (const auto &sst: layers[level]) {
+            tables.push_back(std::make_pair(sst, scanPriority(level, sst)));
+        }
+    }
+    return new Iterator(memTable, tables, vlog, std::move(lock));
+}
+
+/**
+ * Coroutine version of get(): suspends on the vlog read instead of blocking.
+ * Keys and offsets are resolved before the first suspension, so puts made by
+ * other coroutines on the same loop while this one waits are not observed,
+ * unless gc moves the value during the read: then the key is resolved again.
+ */
+Task<std::string> KVStore::getAsync(EventLoop &loop, uint64_t key) {
+    uint64_t offset, valueLen;
+    uint64_t lastOffset = UINT64_MAX;
+    std::string inlineValue;
+    while (true) {
+        {
+            // 挂起之前释放锁，等待读取期间不阻塞写入
+            std::shared_lock<RWLock> lock(versionLock);
+            std::string val = memTable->get(key);
+            if (val == "~DELETED~") {
+                co_return std::string("");
+            } else if (val != "") {
+                co_return val;
+            }
+            if (!locateInSSTables(key, offset, valueLen, &inlineValue) || !valueLen) {
+                co_return std::string("");
+            }
+        }
+        if (valueLen & INLINE_FLAG) {
+            co_return inlineValue;
+        }
+        // 不持锁等待读取期间 gc 可能把值搬到 vlog 末尾并回收旧的空间，读出的是空洞；
+        // 重新定位后位置变了就再读一次，位置没变说明 vlog 中的条目本身已经损坏
+        if (offset == lastOffset) {
+            co_return std::string("");
+        }
+        lastOffset = offset;
+        std::string val = co_await vlog->readValueAsync(loop, offset, valueLen);
+        if (!val.empty()) {
+            co_return val;
+        }
+    }
+}
+
+/**
+ * Coroutine version of scan(): the newest version of every key in [key1, key2]
+ * is resolved from the in-memory indexes, then all value reads are submitted
+ * at once and the coroutine resumes when the last one completes. Values that
+ * gc moved while the reads were in flight are fetched again with getAsync().
+ */
+Task<std::list<std::pair<uint64_t, std::string>>> KVStore::scanAsync(EventLoop &loop, uint64_t key1, uint64_t key2) {
+    std::list<std::pair<uint64_t, std::string>> list;
+    if (key1 > key2) {
+        co_return list;
+    }
+    std::vector<uint64_t> keys;
+    std::vector<vlog_read> reads;
+    std::vector<std::string> vals;
+    {
+        std::shared_lock<RWLock> lock(versionLock);
+        collectRange(key1, key2, SIZE_MAX, false, keys, reads, vals);
+    }
+    co_await vlog->readValuesAsync(loop, reads, vals);
+    for (const vlog_read &read: reads) {
+        if (vals[read.slot].empty()) {
+            // gc 在读取期间搬走了这个值并回收了旧的空间，按键重新定位；期间被删除的键不再返回
+            vals[read.slot] = co_await getAsync(loop, keys[read.slot]);
+        }
+    }
+    for (size_t i = 0; i < keys.size(); ++i) {
+        if (!vals[i].empty()) {
+            list.push_back(std::make_pair(keys[i], std::move(vals[i])));
+        }
+    }
+    co_return list;
 }
 
 void KVStore::convertMemTableToSSTable() {
-    layers[0].push_back(memTable->convertSSTable(layers[0].size(), stamp++, dir_path, vlog_path));
+    off_t vlogEnd = vlog->end();
+    layers[0].push_back(memTable->convertSSTable(nextTableId(0), stamp++, dir_path, vlog, hashIndex));
+    uint64_t bytes = vlog->end() - vlogEnd + layers[0].back()->diskSize();
+    flushBytes += bytes;
+    // 转储在写入路径上持有独占锁，以高优先级记账不等待，透支的部分由合并和 gc 让出
+    rateLimiter->request(bytes, IO_HIGH);
     delete memTable;
     memTable = new MemTable(0.5, bloomSize);
+    scheduleCompaction();
 }
 
 
@@ -191,112 +876,316 @@ void KVStore::convertMemTableToSSTable() {
  * chunk_size is the size in byte you should AT LEAST recycle.
  */
 void KVStore::gc(uint64_t chunk_size) {
-    int fd = open(vlog_path.c_str(), O_RDWR, 0644);
-    lseek(fd, tail, SEEK_SET);
-    char buf[BUFFER_SIZE];
-    read(fd, buf, 1);
-    uint64_t read_len = 0;
-    read_len = readVlogAndWriteToMemTable(chunk_size, fd, buf, read_len);
-    close(fd);
-    convertMemTableToSSTable();
-    for (int i = 0; i < layers.size() && layers[i].size() > (1 << i + 2); i++) {
-        compaction(i);
-    }
-    utils::de_alloc_file(vlog_path, tail, read_len);
+    // 读取 vlog 之前、拿锁之前限速，等待期间不阻塞读写
+    rateLimiter->request(chunk_size, IO_LOW);
+    throttleWrites();
+    std::unique_lock<RWLock> lock(versionLock);
+    uint64_t read_len = readVlogAndWriteToMemTable(chunk_size);
+    // 仍然有效的值随内存表写回 vlog 末尾之后，才能回收旧的空间；新的 SSTable 遮住了指向旧空间的条目，合并交给后台线程
+    if (memTable->get_numkv()) {
+        convertMemTableToSSTable();
+    }
+    vlog->punchHole(tail, read_len);
     tail = read_len + tail;
 }
 
-void KVStore::updateMinMaxKeys(int compact_size, uint64_t &min_key, uint64_t &max_key, int level) {
-    int i = 0;
-    for (const auto &layer: layers[level]) {
-        if (i >= compact_size) break;
-        max_key = std::max(max_key, layer->get_maxkey());
-        min_key = std::min(min_key, layer->get_minkey());
-        i++;
+bool KVStore::locateInSSTables(uint64_t key, uint64_t &offset, uint64_t &valueLen, std::string *inlineValue,
+                               bool userRead) {
+    bloomHash h = bloomFilter::hash(key, BLOOMHASHNUM);
+    std::vector<char> hits;
+    for (int i = 0; i < (int) layers.size(); ++i) {
+        if (overlapping(i)) {
+            queryLayer(i, h, hits);
+            for (int j = (int) layers[i].size() - 1; j >= 0; --j) {
+                if (!hits[j]) {
+                    continue;
+                }
+                if (layers[i][j]->locate(key, offset, valueLen, inlineValue)) {
+                    return true;
+                }
+                if (userRead) {
+                    recordWastedProbe(i, layers[i][j]);
+                }
+            }
+            continue;
+        }
+        int j = findTable(i, key);
+        if (j != -1 && layers[i][j]->query(h)) {
+            if (layers[i][j]->locate(key, offset, valueLen, inlineValue)) {
+                return true;
+            }
+            if (userRead) {
+                recordWastedProbe(i, layers[i][j]);
+            }
+        }
     }
+    return false;
 }
 
-void KVStore::prepareNextLayer(int level) {
-    if (level + 1 == layers.size()) {
-        layers.push_back(std::vector<SSTable *>());
-    }
+void KVStore::setCacheCapacity(uint64_t capacity) {
+    cache->setCapacity(capacity);
 }
 
-void KVStore::collectOverlappingSSTables(int level, uint64_t min_key, uint64_t max_key, std::vector<int> &index,
-                                         std::vector<int> &it) {
-    int i = 0;
-    for (const auto &layer: layers[level + 1]) {
-        if (layer->get_minkey() <= max_key && layer->get_maxkey() >= min_key) {
-            index.push_back(i);
-            it.push_back(0);
+cache_stats KVStore::getCacheStats() const {
+    return cache->getStats();
+}
+
+/**
+ * Returns counters accumulated over all compactions installed since open.
+ */
+compaction_stats KVStore::getCompactionStats() const {
+    std::lock_guard<std::mutex> guard(compactMutex);
+    return compactStats;
+}
+
+/**
+ * Returns the compaction style the store was opened with.
+ */
+compaction_style KVStore::getCompactionStyle() const {
+    return style;
+}
+
+/**
+ * Sets the limits used by FIFO compaction: once the SSTables and the vlog
+ * take more than maxBytes, or the oldest SSTable is older than ttlSeconds,
+ * the oldest SSTables are deleted. 0 disables a limit. Ignored by the
+ * other compaction styles.
+ */
+void KVStore::setFifoLimits(uint64_t maxBytes, uint64_t ttlSeconds) {
+    std::unique_lock<RWLock> lock(versionLock);
+    fifoMaxBytes = maxBytes;
+    fifoTtlSeconds = ttlSeconds;
+    scheduleCompaction();
+}
+
+/**
+ * Builds a hash index (key to entry) in SSTables written from now on, so
+ * point lookups skip the binary search. The index takes about 4KB per
+ * table and counts toward the table size. Existing tables keep whatever
+ * they were written with.
+ */
+void KVStore::setHashIndex(bool enabled) {
+    hashIndex = enabled;
+}
+
+/**
+ * Lets each compaction be split into at most the given number of key
+ * ranges, merged on separate threads; 1 disables splitting. A range is
+ * only split off when it has at least SUBCOMPACTION_MIN_ENTRIES entries.
+ * Defaults to SUBCOMPACTIONS, capped at the number of cores.
+ */
+void KVStore::setSubcompactions(unsigned ranges) {
+    subcompactions = std::max(1u, ranges);
+}
+
+/**
+ * Returns the current cap on key ranges per compaction.
+ */
+unsigned KVStore::getSubcompactions() const {
+    return subcompactions;
+}
+
+/**
+ * Caps background I/O (flush, compaction output and gc reads) at the given
+ * bytes per second; 0 removes the cap. Takes effect immediately, including
+ * for compactions and gc calls already waiting.
+ */
+void KVStore::setRateLimit(uint64_t bytesPerSecond) {
+    rateLimiter->setBytesPerSecond(bytesPerSecond);
+}
+
+uint64_t KVStore::getRateLimit() const {
+    return rateLimiter->getBytesPerSecond();
+}
+
+rate_limiter_stats KVStore::getRateLimiterStats() const {
+    return rateLimiter->getStats();
+}
+
+/**
+ * Reports write amplification since open and the current space
+ * amplification. Walks every live key, so it costs as much as a full
+ * key scan; values are not read.
+ */
+amplification_stats KVStore::getAmplificationStats() {
+    amplification_stats stats{};
+    uint64_t offset, valueLen;
+    Iterator *iter = newIterator();
+    for (iter->seekToFirst(); iter->valid(); iter->next()) {
+        stats.live_bytes += sizeof(uint64_t) + (iter->location(offset, valueLen) ? valueLen : iter->value().size());
+    }
+    stats.user_bytes = userBytes;
+    stats.flush_bytes = flushBytes;
+    for (const auto &layer: layers) {
+        for (const auto &sst: layer) {
+            stats.disk_bytes += sst->diskSize();
         }
-        i++;
     }
+    stats.disk_bytes += vlog->end() - tail;
+    delete iter;
+    stats.compaction_bytes = getCompactionStats().bytes_written;
+    stats.write_amp = stats.user_bytes ? (double) (stats.flush_bytes + stats.compaction_bytes) / stats.user_bytes : 0;
+    stats.space_amp = stats.live_bytes ? (double) stats.disk_bytes / stats.live_bytes : 0;
+    return stats;
 }
 
-void
-KVStore::addKVToPriorityQueue(int level, int compact_size, std::vector<int> &it, std::priority_queue <kv_info> &kvs,
-                              std::vector<int> &index) {
-    int i = index.size();
-    for (auto idx = index.rbegin(); idx != index.rend(); ++idx, --i) {
-        if (it[i - 1] != layers[level + 1][*idx]->get_numkv()) {
-            SSTable *sst = layers[level + 1][*idx];
-            kvs.push(kv_info{sst->get_keys()[0], sst->get_valueLens()[0], sst->getStamp(), sst->get_offsets()[0],
-                             i - 1});
-            it[i - 1]++;
-        }
+void KVStore::updateMinMaxKeys(const std::vector<int> &upperIndex, uint64_t &min_key, uint64_t &max_key, int level) {
+    for (int i: upperIndex) {
+        max_key = std::max(max_key, layers[level][i]->get_maxkey());
+        min_key = std::min(min_key, layers[level][i]->get_minkey());
     }
-    i = 0;
-    for (auto &layer: layers[level]) {
-        if (i >= compact_size) break;
-        it.push_back(0);
-        if (it.back() != layer->get_numkv()) {
-            kvs.push(
-                    kv_info{layer->get_keys()[0], layer->get_valueLens()[0], layer->getStamp(), layer->get_offsets()[0],
-                            i + index.size()});
-            it.back()++;
+}
+
+void KVStore::collectOverlappingSSTables(int level, uint64_t min_key, uint64_t max_key, std::vector<int> &index) {
+    int i = 0;
+    for (const auto &layer: layers[level + 1]) {
+        if (layer->get_minkey() <= max_key && layer->get_maxkey() >= min_key) {
+            index.push_back(i);
         }
         i++;
     }
 }
 
-void KVStore::deleteOldSSTables(int level, std::vector<int> &index, int compact_size) {
-    int i = index.size();
-    for (auto idx = index.rbegin(); idx != index.rend(); ++idx, --i) {
+void KVStore::deleteOldSSTables(int level, std::vector<int> &upperIndex, std::vector<int> &index) {
+    // 两组下标都是升序，从后往前删除不影响前面的下标
+    for (auto idx = index.rbegin(); idx != index.rend(); ++idx) {
         layers[level + 1][*idx]->delete_disk();
+        forgetSeekCandidate(layers[level + 1][*idx]);
         delete layers[level + 1][*idx];
         layers[level + 1].erase(layers[level + 1].begin() + *idx);
     }
-    i = compact_size;
-    for (auto iter = layers[level].rbegin(); iter != layers[level].rbegin() + compact_size; ++iter, --i) {
-        (*iter)->delete_disk();
-        delete *iter;
-        layers[level].erase(layers[level].begin() + i - 1);
+    for (auto idx = upperIndex.rbegin(); idx != upperIndex.rend(); ++idx) {
+        layers[level][*idx]->delete_disk();
+        forgetSeekCandidate(layers[level][*idx]);
+        delete layers[level][*idx];
+        layers[level].erase(layers[level].begin() + *idx);
     }
 }
 
 void KVStore::updateSSTableIndices(int level) {
-    int i = 0;
-    for (auto &layer: layers[level]) {
-        layer->set_id(i++);
+    renumberLayer(level);
+    renumberLayer(level + 1);
+}
+
+void KVStore::renumberLayer(int level) {
+    // 先把需要改名的 SSTable 挪到临时编号，避免重命名时覆盖同层尚未改名的文件
+    int base = layers[level].size();
+    for (const auto &sst: layers[level]) {
+        base = std::max(base, sst->get_id() + 1);
     }
-    i = 0;
-    for (auto &layer: layers[level + 1]) {
-        layer->set_id(i++);
+    for (int i = 0; i < (int) layers[level].size(); i++) {
+        if (layers[level][i]->get_id() != i) {
+            layers[level][i]->set_id(base + i);
+        }
+    }
+    for (int i = 0; i < (int) layers[level].size(); i++) {
+        if (layers[level][i]->get_id() != i) {
+            layers[level][i]->set_id(i);
+        }
     }
 }
 
-void KVStore::compaction(int level) {
-    uint64_t min_key, max_key, max_stamp;
-    int compact_size = determineCompactSize(level, min_key, max_key, max_stamp);
+int KVStore::nextTableId(int level) const {
+    // 比本层所有文件的编号都大；删除文件之后不重新编号，编号可能大于文件数
+    int id = layers[level].size();
+    for (const auto &sst: layers[level]) {
+        id = std::max(id, sst->get_id() + 1);
+    }
+    return id;
+}
 
-    prepareNextLevel(level);
+void KVStore::rebuildFences(int level) {
+    while (fences.size() < layers.size()) {
+        fences.push_back(std::vector<fence>());
+    }
+    fences[level].clear();
+    // 第 0 层和分层合并时各层的 SSTable 之间键范围可能重叠，不使用栅栏索引
+    if (overlapping(level)) {
+        return;
+    }
+    for (const auto &sst: layers[level]) {
+        assert(fences[level].empty() || fences[level].back().max_key < sst->get_minkey());
+        fences[level].push_back(fence{sst->get_minkey(), sst->get_maxkey()});
+    }
+}
 
-    std::vector<int> index;
-    std::vector<int> it;
-    collectOverlappingSSTables(level, min_key, max_key, index, it);
+int KVStore::findTable(int level, uint64_t key) const {
+    if (level >= (int) fences.size()) {
+        return -1;
+    }
+    const std::vector<fence> &f = fences[level];
+    // 同层 SSTable 互不重叠且按键有序，二分找到第一个 max_key >= key 的 SSTable
+    auto iter = std::lower_bound(f.begin(), f.end(), key, [](const fence &a, uint64_t k) {
+        return a.max_key < k;
+    });
+    if (iter == f.end() || iter->min_key > key) {
+        return -1;
+    }
+    return int(iter - f.begin());
+}
 
-    mergeAndWriteSSTables(level, compact_size, index, it);
+bool KVStore::pickCompaction(compaction_job &job) {
+    // 调用者持有 versionLock 的独占锁；合并得分不小于 1 的层中选得分最高的，都不需要合并时再看有没有点查触发的合并
+    int level = -1;
+    double bestScore = 0;
+    for (int i = 0; i < (int) layers.size(); ++i) {
+        double score = compactionScore(i);
+        if (score >= 1 && score > bestScore) {
+            level = i;
+            bestScore = score;
+        }
+    }
+    int seekIndex = -1;
+    if (level == -1) {
+        level = pickSeekCompaction(seekIndex);
+    }
+    if (level != -1) {
+        uint64_t min_key, max_key;
+        job.level = level;
+        determineInputs(level, job.upperIndex, min_key, max_key, seekIndex);
+        prepareNextLevel(level);
+        // 新加的层也要有对应的栅栏索引，合并期间读操作会遍历到它
+        rebuildFences(level + 1);
+        job.index.clear();
+        // 分层合并只把本层的段合并成下一层的一个新段，不重写下一层已有的段
+        if (style == LEVELED_COMPACTION) {
+            collectOverlappingSSTables(level, min_key, max_key, job.index);
+        }
+        job.upper.clear();
+        for (int i: job.upperIndex) {
+            job.upper.push_back(layers[level][i]);
+        }
+        job.lower.clear();
+        for (int i: job.index) {
+            job.lower.push_back(layers[level + 1][i]);
+        }
+        job.next_id = nextTableId(level + 1);
+        // 更深的层都是空的，输出层就是最底层，不会再有更旧的版本需要删除标记去遮住；
+        // 分层合并时下一层已有的段比输出更旧，也要为空
+        job.bottommost = style == LEVELED_COMPACTION || layers[level + 1].empty();
+        for (int deeper = level + 2; deeper < (int) layers.size(); ++deeper) {
+            if (!layers[deeper].empty()) {
+                job.bottommost = false;
+            }
+        }
+        job.outputs.clear();
+        job.stats = compaction_stats{};
+        job.stats.seek_compactions = seekIndex != -1;
+        job.trivial = isTrivialMove(job);
+        // 点查触发的合并只是原样移动时，同一个误判在下一层照样会被探测到，读放大没有减少；
+        // 放弃这次合并并清零计数，只有真正归并才能去掉白白的探测
+        if (job.trivial && seekIndex != -1) {
+            layers[level][seekIndex]->resetWastedProbes();
+            return false;
+        }
+        if (job.trivial) {
+            job.stats.trivial_moves = job.upper.size();
+        } else {
+            job.stats.input_files = job.upper.size() + job.lower.size();
+        }
+        return true;
+    }
+    return false;
 }
 
 
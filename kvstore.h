@@ -4,62 +4,172 @@
 #include "memtable.h"
 #include "sstable.h"
 #include "config.h"
+#include "valuecache.h"
+#include "vlog.h"
+#include "eventloop.h"
+#include "iterator.h"
+#include "ratelimiter.h"
 #include <vector>
 #include <list>
 #include <queue>
 #include <string>
+#include <thread>
+#include <mutex>
+#include <shared_mutex>
+#include "rwlock.h"
+#include <condition_variable>
+#include <atomic>
+
+//一次后台合并：选取时在锁内记下输入 SSTable 的指针和下标，合并和写出期间不持有 versionLock
+struct compaction_job {
+    int level;
+    std::vector<int> upperIndex;   // 本层参与合并的 SSTable 的下标：第 0 层是全部，其余层是一个（分层合并时是最旧的几个段）
+    std::vector<int> index;        // 下一层中与之键范围重叠的 SSTable 的下标，分层合并时为空
+    std::vector<SSTable*> upper;   // 本层参与合并的 SSTable
+    std::vector<SSTable*> lower;   // 下一层参与合并的 SSTable
+    int next_id;                   // 输出文件的临时编号，不与下一层现有编号冲突
+    uint64_t new_stamp;            // 输出文件的时间戳，取所有输入中最大的
+    bool bottommost;               // 下一层之下再没有数据，删除标记可以直接丢弃
+    bool trivial;                  // 输入与下一层和彼此都不重叠，安装时直接把文件移到下一层，不归并也不重写
+    std::vector<SSTable*> outputs;
+    compaction_stats stats;        // 本次合并的统计，安装时累加到 KVStore
+};
+
+//流式合并时正在填充的输出 SSTable，写满后立即落盘并清空，合并占用的内存不超过一个输出文件
+struct output_builder {
+    std::vector<uint64_t> keys;
+    std::vector<uint64_t> offsets;
+    std::vector<uint64_t> valueLens;
+    std::string inlineData;
+    bloomFilter* bloom;
+    uint64_t min_key;
+    uint64_t max_key;
+};
 
 class KVStore : public KVStoreAPI {
 private:
     uint64_t stamp;       // 时间戳
-    uint64_t head;        // 头部
     uint64_t tail;        // 尾部
     uint64_t bloomSize;   // 布隆过滤器大小
     std::string dir_path;
-    std::string vlog_path;
     MemTable* memTable;
+    ValueCache* cache;    // vlog 值缓存
+    IOBackend* io;        // 异步读后端，vlog 的批量读取都经过它
+    VLog* vlog;           // vlog 文件，整个生命周期内保持打开
+    RateLimiter* rateLimiter; // 转储、合并和 gc 的 I/O 都经过它限速
     std::vector<std::vector<SSTable*>> layers; // 存储每一层的 SSTable
+    std::vector<std::vector<fence>> fences; // 第 1 层及以下每层 SSTable 的键范围，与 layers 一一对应；分层合并时为空
+    compaction_style style; // 合并策略，分层合并时第 1 层及以下按（时间戳，最小键）排序，同一个段的 SSTable 时间戳相同
+    uint64_t fifoMaxBytes;  // FIFO 合并的大小上限，在 versionLock 下读写
+    uint64_t fifoTtlSeconds; // FIFO 合并的保留时间，在 versionLock 下读写
+    std::atomic<bool> hashIndex; // 新写出的 SSTable 是否建立哈希索引，后台合并不持锁读取
+    std::atomic<unsigned> subcompactions; // 一次合并最多切成的键范围数，后台合并不持锁读取
+    uint64_t userBytes;   // put 和 del 写入的字节数，在 versionLock 的独占锁下更新
+    uint64_t flushBytes;  // 转储写出的字节数，在 versionLock 的独占锁下更新
+    RWLock versionLock; // 保护 memTable、layers 和 fences：读操作持共享锁，写入、转储和安装合并结果持独占锁
+    std::mutex compactionLock;     // 后台线程从选取输入到安装结果一直持有，reset 借此等待正在进行的合并
+    mutable std::mutex compactMutex; // 保护下面的调度状态和合并统计
+    std::condition_variable compactCond; // 有新的合并工作或需要退出时唤醒后台线程
+    std::condition_variable stallCond;   // 合并完成后唤醒被限流的写入
+    bool compactPending;
+    bool fifoTimer;                // FIFO 合并设置了保留时间，后台线程需要定时醒来检查
+    const SSTable* seekCandidate;  // 白白探测次数达到阈值、等待合并到下一层的 SSTable，没有时为空
+    int seekLevel;                 // seekCandidate 所在的层
+    std::atomic<bool> stopCompactor;
+    size_t level0Files;            // 第 0 层的 SSTable 数，限流时在 compactMutex 下读取
+    compaction_stats compactStats;
+    std::thread compactor;
 
     // 私有函数声明
     void process_sst(std::vector<std::string>& files, std::priority_queue<sst_info>& sstables);
     void write_sst(std::priority_queue<sst_info>& sstables);
+    bool levelOverlaps(int level) const;
+    static bool containsKey(const SSTable *sst, uint64_t key);
+    void dropCoveredTables(int level);
+    void separateOverlappingTables(int level);
     void checkAndConvertMemTable();
-    void doCompaction();
+    void scheduleCompaction();
+    void backgroundCompaction();
+    void runCompactions();
+    void stopBackgroundCompaction();
+    void throttleWrites();
+    bool pickCompaction(compaction_job& job);
+    void installCompaction(compaction_job& job);
+    std::string getValue(uint64_t key);
+    void putValue(uint64_t key, const std::string& s);
+    Iterator* createIterator(std::shared_lock<RWLock> lock = std::shared_lock<RWLock>());
     std::string getValueFromMemTable(uint64_t key);
-    std::string getValueFromSSTable(uint64_t key);
+    std::string getValueFromSSTable(uint64_t key, const bloomHash &h);
+    void queryLayer(int level, const bloomHash &h, std::vector<char> &hits) const;
     void deleteAllSSTables();
     void deleteAllFilesInDir();
-    bool needCompaction(int level) const;
+    uint64_t levelBytes(int level) const;
+    uint64_t levelTargetBytes(int level) const;
+    double compactionScore(int level) const;
+    int pickInputFile(int level) const;
+    bool isTrivialMove(const compaction_job& job) const;
+    void recordWastedProbe(int level, const SSTable* sst);
+    int pickSeekCompaction(int& index);
+    void forgetSeekCandidate(const SSTable* sst);
+    uint64_t fifoBytes() const;
+    uint64_t expireFifoTables();
+    bool overlapping(int level) const;
+    int countRuns(int level) const;
+    int oldestRunsEnd(int level, int runs) const;
     bool isMemTableFull() const;
     void convertMemTableToSSTable();
-    uint64_t readVlogAndWriteToMemTable(uint64_t chunk_size, int fd, char* buf, uint64_t& read_len);
-    int determineCompactSize(int level);
-    void updateMinMaxKeys(int compact_size, uint64_t& min_key, uint64_t& max_key, int level);
-    void prepareNextLayer(int level);
-    void collectOverlappingSSTables(int level, uint64_t min_key, uint64_t max_key, std::vector<int>& index, std::vector<int>& it);
-    void addKVToPriorityQueue(int level, int compact_size, std::vector<int>& it, std::priority_queue<kv_info>& kvs, std::vector<int>& index);
-    void deleteOldSSTables(int level, std::vector<int>& index, int compact_size);
+    uint64_t readVlogAndWriteToMemTable(uint64_t chunk_size);
+    void updateMinMaxKeys(const std::vector<int>& upperIndex, uint64_t& min_key, uint64_t& max_key, int level);
+    void collectOverlappingSSTables(int level, uint64_t min_key, uint64_t max_key, std::vector<int>& index);
+    void deleteOldSSTables(int level, std::vector<int>& upperIndex, std::vector<int>& index);
     void updateSSTableIndices(int level);
-    void compaction(int level);
-    void createNewSSTables(int level, std::vector<kv_info>& kv_list);
+    void renumberLayer(int level);
+    int nextTableId(int level) const;
+    void rebuildFences(int level);
+    int findTable(int level, uint64_t key) const;
+    uint64_t scanPriority(int level, const SSTable *sst) const;
+    void collectRange(uint64_t key1, uint64_t key2, size_t limit, bool reverse, std::vector<uint64_t>& keys, std::vector<vlog_read>& reads, std::vector<std::string>& vals);
+    bool locateInSSTables(uint64_t key, uint64_t& offset, uint64_t& valueLen, std::string* inlineValue = nullptr,
+                          bool userRead = true);
+    void addToOutput(compaction_job& job, output_builder& out, const TableCursor& top);
+    void finishOutput(compaction_job& job, output_builder& out);
     void process_vlog();
-    std::vector<kv_info> collectKVList(std::vector<int>& it, std::priority_queue<kv_info>& kvs, int level, std::vector<int>& index, int compact_size);
-    void removeDeletedPairs(std::list<std::pair<uint64_t, std::string>>& list, std::vector<std::vector<std::pair<uint64_t, std::string>>>& scanRes, std::vector<int>& it, std::priority_queue<kv>& kvs);
-    void getPairsFromMemTable(uint64_t key1, uint64_t key2, std::vector<std::vector<std::pair<uint64_t, std::string>>>& scanRes, std::vector<int>& it, std::priority_queue<kv>& kvs);
-    void getPairsFromSSTable(uint64_t key1, uint64_t key2, std::vector<std::vector<std::pair<uint64_t, std::string>>>& scanRes, std::vector<int>& it, std::priority_queue<kv>& kvs);
 
-    int determineCompactSize(int level, uint64_t& min_key, uint64_t& max_key, uint64_t& max_stamp);
+    void determineInputs(int level, std::vector<int>& upperIndex, uint64_t& min_key, uint64_t& max_key, int seekIndex = -1);
     void prepareNextLevel(int level);
-//    void collectOverlappingSSTables(int level, uint64_t min_key, uint64_t max_key, std::vector<int>& index, std::vector<int>& it);
-    void mergeAndWriteSSTables(int level, int compact_size, std::vector<int>& index, std::vector<int>& it);
+    std::vector<uint64_t> splitCompaction(const compaction_job& job) const;
+    uint64_t countEntries(const compaction_job& job, uint64_t lo, uint64_t hi, bool last) const;
+    void mergeRange(compaction_job& job, uint64_t lo, uint64_t hi, bool last);
+    void mergeAndWriteSSTables(compaction_job& job);
 
 public:
-    KVStore(const std::string& dir, const std::string& vlog);
+    KVStore(const std::string& dir, const std::string& vlog, compaction_style style = COMPACTION_STYLE);
     ~KVStore();
     void put(uint64_t key, const std::string& s) override;
     std::string get(uint64_t key) override;
+    bool get(uint64_t key, ValueHandle& value);
+    std::vector<std::string> multiGet(const std::vector<uint64_t>& keys);
     bool del(uint64_t key) override;
     void reset() override;
     void scan(uint64_t key1, uint64_t key2, std::list<std::pair<uint64_t, std::string>>& list) override;
+    void scan(uint64_t key1, uint64_t key2, size_t limit, bool reverse, std::list<std::pair<uint64_t, std::string>>& list);
+    std::vector<uint64_t> scanKeys(uint64_t key1, uint64_t key2);
+    uint64_t countRange(uint64_t key1, uint64_t key2);
+    range_size approximateSize(uint64_t key1, uint64_t key2);
+    Iterator* newIterator();
+    Task<std::string> getAsync(EventLoop& loop, uint64_t key);
+    Task<std::list<std::pair<uint64_t, std::string>>> scanAsync(EventLoop& loop, uint64_t key1, uint64_t key2);
     void gc(uint64_t chunk_size) override;
+    void setCacheCapacity(uint64_t capacity);
+    cache_stats getCacheStats() const;
+    compaction_stats getCompactionStats() const;
+    compaction_style getCompactionStyle() const;
+    void setFifoLimits(uint64_t maxBytes, uint64_t ttlSeconds);
+    void setHashIndex(bool enabled);
+    void setSubcompactions(unsigned ranges);
+    unsigned getSubcompactions() const;
+    void setRateLimit(uint64_t bytesPerSecond);
+    uint64_t getRateLimit() const;
+    rate_limiter_stats getRateLimiterStats() const;
+    amplification_stats getAmplificationStats();
 };
\ No newline at end of file
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "kvstore.h"
+#include <stdexcept>
 
 void KVStore::process_sst(std::vector <std::string> &files, std::priority_queue <sst_info> &sstables) {
     for (const auto &file: files) {
@@ -14,7 +15,9 @@ void KVStore::process_sst(std::vector <std::string> &files, std::priority_queue
 }
 
 bool KVStore::isMemTableFull() const {
-    return memTable->size() >= SSTABLESIZE;
+    // 再写入一个带最长内联值的新键就可能超过 SSTABLESIZE 时转储；哈希索引的槽数按 2 的幂增长，不能等超过了再转储
+    return SSTable::tableSize(memTable->get_numkv() + 1, memTable->get_inlinebytes() + INLINE_THRESHOLD - 1,
+                              bloomSize, hashIndex) > SSTABLESIZE;
 }
 
 void KVStore::write_sst(std::priority_queue <sst_info> &sstables) {
@@ -25,280 +28,279 @@ void KVStore::write_sst(std::priority_queue <sst_info> &sstables) {
         while (layers.size() <= sst.level) {
             layers.push_back(std::vector<SSTable *>());
         }
-        layers[sst.level].push_back(new SSTable(sst.level, sst.id, sst.file, dir_path, vlog_path, bloomSize));
+        layers[sst.level].push_back(new SSTable(sst.level, sst.id, sst.file, dir_path, vlog, bloomSize));
         stamp = std::max(layers[sst.level].back()->getStamp() + 1, stamp);
     }
-}
-
-uint64_t KVStore::readVlogAndWriteToMemTable(uint64_t chunk_size, int fd, char *buf, uint64_t &read_len) {
-    uint64_t vlen;
-    uint64_t key;
-    bool isNewest = true;
-    while (read_len < chunk_size && buf[0] == (char) MAGIC) {
-        read(fd, buf, VLOGPADDING - 1);
-        key = *(uint64_t * )(buf + 2);
-        vlen = *(uint32_t * )(buf + 10);
-        read(fd, buf, vlen);
-        if (memTable->get(key) == "") {
-            for (const auto &layer: layers) {
-                if (!isNewest) break;
-                for (auto it = layer.rbegin(); it != layer.rend(); ++it) {
-                    if ((*it)->query(key)) {
-                        off_t offset = (*it)->get_offset(key);
-                        if (offset != 1) {
-                            buf[vlen] = 0;
-                            if (offset != 2 && offset == read_len + tail) {
-                                put(key, buf);
-                            } else {
-                                isNewest = false;
-                            }
-                        }
-                    }
+    // 分级合并时第 1 层及以下互不重叠。合并的输出落盘之后、删除输入之前崩溃会留下同层重叠的文件，
+    // 打开时整理成互不重叠的状态；分层和 FIFO 合并时同层重叠是正常的，不需要处理
+    for (int level = 1; level < (int) layers.size() && style == LEVELED_COMPACTION; level++) {
+        if (levelOverlaps(level)) {
+            dropCoveredTables(level);
+            separateOverlappingTables(level);
+        }
+    }
+    // 第 0 层按时间戳排序，第 1 层及以下按键范围排序（分层和 FIFO 合并时先按时间戳分段），
+    // 编号与顺序不一致时（例如改名中途退出，或 FIFO 合并删除文件后留下的空号）重新编号
+    for (int level = 0; level < (int) layers.size(); level++) {
+        if (level) {
+            bool tiered = style != LEVELED_COMPACTION;
+            std::sort(layers[level].begin(), layers[level].end(), [tiered](const SSTable *a, const SSTable *b) {
+                if (tiered && a->getStamp() != b->getStamp()) {
+                    return a->getStamp() < b->getStamp();
                 }
-            }
+                return a->get_minkey() < b->get_minkey();
+            });
         } else {
-            read_len = read_len + VLOGPADDING + vlen;
-            read(fd, buf, 1);
+            std::sort(layers[0].begin(), layers[0].end(), [](const SSTable *a, const SSTable *b) {
+                return a->getStamp() < b->getStamp();
+            });
         }
+        renumberLayer(level);
+        rebuildFences(level);
     }
-    return read_len;
 }
 
-int KVStore::determineCompactSize(int level) {
-    int compact_size = level ? layers[level].size() / 2 : layers[level].size();
-    uint64_t max_stamp = layers[level][compact_size - 1]->getStamp();
-    while (compact_size < layers[level].size() && layers[level][compact_size]->getStamp() <= max_stamp) {
-        compact_size++;
+bool KVStore::levelOverlaps(int level) const {
+    std::vector<SSTable *> sorted = layers[level];
+    std::sort(sorted.begin(), sorted.end(), [](const SSTable *a, const SSTable *b) {
+        return a->get_minkey() < b->get_minkey();
+    });
+    for (size_t i = 1; i < sorted.size(); i++) {
+        if (sorted[i - 1]->get_maxkey() >= sorted[i]->get_minkey()) {
+            return true;
+        }
     }
-    return compact_size;
+    return false;
 }
 
-void KVStore::createNewSSTables(int level, std::vector <kv_info> &kv_list) {
-    int max_kvnum = (SSTABLESIZE - bloomSize - HEADERSIZE) / 20;
-    for (int i = 0; i < kv_list.size(); i += max_kvnum) {
-        uint64_t max_key = 0;
-        uint64_t min_key = MINKEY;
-        uint64_t new_step = 0;
-        uint64_t kv_num = std::min(max_kvnum, (int) kv_list.size() - i);
-        std::vector <uint64_t> keys;
-        std::vector <uint64_t> offsets, valueLens;
-        bloomFilter *bloom_p = new bloomFilter(bloomSize, 3);
-        for (int j = i; j < std::min(i + max_kvnum, (int) kv_list.size()); j++) {
-            max_key = std::max(max_key, kv_list[j].key);
-            min_key = std::min(min_key, kv_list[j].key);
-            new_step = std::max(new_step, kv_list[j].stamp);
-            keys.push_back(kv_list[j].key);
-            offsets.push_back(kv_list[j].offset);
-            valueLens.push_back(kv_list[j].valueLen);
-            bloom_p->insert(kv_list[j].key);
-        }
-        SSTable *sst = new SSTable({new_step, kv_num, max_key, min_key}, level + 1, layers[level + 1].size(), bloom_p,
-                                   keys, offsets, valueLens, dir_path, vlog_path);
-        sst->write_disk();
-        layers[level + 1].push_back(sst);
-    }
+bool KVStore::containsKey(const SSTable *sst, uint64_t key) {
+    int pos = sst->lowerBound(key);
+    return pos < (int) sst->get_numkv() && sst->keyAt(pos) == key;
 }
 
-void KVStore::process_vlog() {
-    if (utils::fileExists(vlog_path)) {
-        tail = utils::seek_data_block(vlog_path);
-        head = utils::get_end_offset(vlog_path);
-        int fd = open(vlog_path.c_str(), O_RDWR, 0644);
-        lseek(fd, tail, SEEK_SET);
-        char buf[BUFFER_SIZE];
-        while (tail < head) {
-            read(fd, buf, 1);
-            while (buf[0] != (char) MAGIC) {
-                tail++;
-                read(fd, buf, 1);
+void KVStore::dropCoveredTables(int level) {
+    // 按（时间戳，编号）从新到旧排列：合并的输出时间戳不小于输入，编号大于下一层已有的文件，总排在重叠的旧文件前面。
+    // 旧文件的每个键都在同层更新的重叠文件或更上面的层中出现时（包括删除标记），它已经被完整替代，可以删除；
+    // 最底层的合并丢掉的删除标记仍在上一层的输入中，因为安装时先删下一层的输入
+    std::vector<SSTable *> &tables = layers[level];
+    std::sort(tables.begin(), tables.end(), [](const SSTable *a, const SSTable *b) {
+        if (a->getStamp() != b->getStamp()) {
+            return a->getStamp() > b->getStamp();
+        }
+        return a->get_id() > b->get_id();
+    });
+    for (size_t i = 1; i < tables.size();) {
+        SSTable *old = tables[i];
+        std::vector<const SSTable *> newer;
+        for (size_t j = 0; j < i; j++) {
+            if (tables[j]->get_minkey() <= old->get_maxkey() && old->get_minkey() <= tables[j]->get_maxkey()) {
+                newer.push_back(tables[j]);
             }
-            read(fd, buf, VLOGPADDING - 1);
-            uint16_t checkSum = *(uint16_t *) buf;
-            uint64_t key = *(uint64_t * )(buf + 2);
-            uint32_t vlen = *(uint32_t * )(buf + 10);
-            read(fd, buf, vlen);
-            std::string value(buf);
-            uint16_t check_sum = utils::generate_checksum(key, vlen, value);
-            if (check_sum == checkSum) {
-                break;
+        }
+        if (newer.empty()) {
+            i++;
+            continue;
+        }
+        for (int upper = 0; upper < level; upper++) {
+            for (const auto &sst: layers[upper]) {
+                if (sst->get_minkey() <= old->get_maxkey() && old->get_minkey() <= sst->get_maxkey()) {
+                    newer.push_back(sst);
+                }
             }
-            tail = tail + VLOGPADDING + vlen;
         }
-        close(fd);
+        bool covered = true;
+        for (uint64_t k = 0; covered && k < old->get_numkv(); k++) {
+            uint64_t key = old->keyAt(k);
+            covered = std::any_of(newer.begin(), newer.end(), [key](const SSTable *sst) {
+                return containsKey(sst, key);
+            });
+        }
+        if (covered) {
+            old->delete_disk();
+            delete old;
+            tables.erase(tables.begin() + i);
+        } else {
+            i++;
+        }
     }
 }
 
-std::vector <kv_info>
-KVStore::collectKVList(std::vector<int> &it, std::priority_queue <kv_info> &kvs, int level, std::vector<int> &index,
-                       int compact_size) {
-    std::vector <kv_info> kv_list;
-    while (!kvs.empty()) {
-        kv_info min_kv = kvs.top();
-        kvs.pop();
-        if (kv_list.empty() || min_kv.key != kv_list.back().key) {
-            kv_list.push_back(min_kv);
-        } else {
-            assert(kv_list.back().stamp >= min_kv.stamp);
-        }
-        if (min_kv.i >= index.size()) {
-            int i = min_kv.i - index.size();
-            assert(layers[level][i]->get_numkv() == layers[level][i]->get_keys().size());
-            if (it[min_kv.i] != layers[level][i]->get_numkv()) {
-                SSTable *sst = layers[level][i];
-                kvs.push(kv_info{sst->get_keys()[it[min_kv.i]], sst->get_valueLens()[it[min_kv.i]], min_kv.stamp,
-                                 sst->get_offsets()[it[min_kv.i]], min_kv.i});
-                it[min_kv.i]++;
+void KVStore::separateOverlappingTables(int level) {
+    // 剩下的重叠来自合并中途崩溃留下的部分输出，或者按分级合并打开分层合并写出的目录。从新到旧只保留与
+    // 已经看过的文件都不重叠的文件，其余的挪到新插入的下一层，同一个键的新版本总在更上面的层，不丢数据。
+    // 本层已经由 dropCoveredTables 按从新到旧排好
+    std::vector<SSTable *> kept, moved;
+    for (SSTable *sst: layers[level]) {
+        bool overlap = false;
+        for (const std::vector<SSTable *> *seen: {&kept, &moved}) {
+            for (const SSTable *other: *seen) {
+                if (other->get_minkey() <= sst->get_maxkey() && sst->get_minkey() <= other->get_maxkey()) {
+                    overlap = true;
+                }
             }
-        } else if (it[min_kv.i] != layers[level + 1][index[min_kv.i]]->get_numkv()) {
-            SSTable *sst = layers[level + 1][index[min_kv.i]];
-            kvs.push(kv_info{sst->get_keys()[it[min_kv.i]], sst->get_valueLens()[it[min_kv.i]], min_kv.stamp,
-                             sst->get_offsets()[it[min_kv.i]], min_kv.i});
-            it[min_kv.i]++;
         }
+        (overlap ? moved : kept).push_back(sst);
+    }
+    if (moved.empty()) {
+        return;
+    }
+    // 更深的层整体下移一层，从最深的层开始改名，避免与尚未改名的文件重名
+    for (size_t deeper = layers.size() - 1; deeper > (size_t) level; deeper--) {
+        for (SSTable *sst: layers[deeper]) {
+            sst->set_level(deeper + 1, sst->get_id());
+        }
+    }
+    for (SSTable *sst: moved) {
+        sst->set_level(level + 1, sst->get_id());
     }
-    return kv_list;
+    layers[level] = kept;
+    layers.insert(layers.begin() + level + 1, moved);
 }
 
-void KVStore::removeDeletedPairs(std::list <std::pair<uint64_t, std::string>> &list,
-                                 std::vector <std::vector<std::pair < uint64_t, std::string>>
-
-> & scanRes,
-std::vector<int> &it, std::priority_queue<kv>
-& kvs )
-{
-uint64_t last_delete = HEAD;
-while ( !kvs.
-
-empty()
-
-)
-{
-kv min_kv = kvs.top();
-kvs.
-
-pop();
-
-if ( last_delete != min_kv.kv_pair.first )
-{
-if ( min_kv.kv_pair.second == "~DELETED~" )
-{
-last_delete = min_kv.kv_pair.first;
-}else  {
-list.
-push_back( min_kv
-.kv_pair );
-}
+uint64_t KVStore::readVlogAndWriteToMemTable(uint64_t chunk_size) {
+    // 把 [tail, tail + chunk_size) 按 GC_READ_BLOCK 分块，所有块的读取一次提交，再从缓冲区中逐个解析条目
+    uint64_t window = std::min(chunk_size, (uint64_t) (vlog->end() - tail));
+    std::vector<char> buf(window);
+    std::vector<io_request> reqs;
+    for (uint64_t pos = 0; pos < window; pos += GC_READ_BLOCK) {
+        io_request req{};
+        req.offset = tail + pos;
+        req.len = std::min((uint64_t) GC_READ_BLOCK, window - pos);
+        req.buf = buf.data() + pos;
+        reqs.push_back(req);
+    }
+    if (!vlog->readBatch(reqs)) {
+        throw std::runtime_error("Failed to read VLOG file: " + vlog->getPath());
+    }
+    uint64_t read_len = 0;
+    vlog_header header;
+    uint64_t offset, valueLen;
+    std::string value;
+    while (read_len < chunk_size && tail + read_len < (uint64_t) vlog->end()) {
+        off_t entry = tail + read_len;
+        if (read_len + VLOGPADDING <= window) {
+            const char *p = buf.data() + read_len;
+            header.magic = (uint8_t) p[0];
+            header.key = *(uint64_t *) (p + 3);
+            header.valueLen = *(uint32_t *) (p + 11);
+        } else if (!vlog->readHeader(entry, header)) {
+            break;
+        }
+        if (header.magic != (uint8_t) MAGIC) {
+            break;
+        }
+        // 内存表中有这个键说明 vlog 中的版本已经过时；否则只有 SSTable 中的最新版本指向这里时才需要搬走。
+        // gc 的查找不是用户的点查，不计入白白探测的次数
+        if (memTable->get(header.key) == "" && locateInSSTables(header.key, offset, valueLen, nullptr, false) && valueLen &&
+            !(valueLen & INLINE_FLAG) && offset == (uint64_t) entry) {
+            if (read_len + VLOGPADDING + header.valueLen <= window) {
+                value.assign(buf.data() + read_len + VLOGPADDING, header.valueLen);
+            } else {
+                // 跨过窗口末尾的最后一个条目单独读取
+                value.resize(header.valueLen);
+                vlog->read(entry + VLOGPADDING, header.valueLen, &value[0]);
+            }
+            putValue(header.key, value);
+        }
+        read_len += VLOGPADDING + header.valueLen;
+    }
+    return read_len;
 }
-if ( it[min_kv.i] != scanRes[min_kv.i].
-
-size()
 
-)
-{
-kvs.
-push( kv{scanRes[min_kv.i][it[min_kv.i]], min_kv.stamp, min_kv.i}
-);
-it[min_kv.i]++;
-}
-}
+void KVStore::addToOutput(compaction_job &job, output_builder &out, const TableCursor &top) {
+    // 放不下这个条目时先写出当前文件，输出文件不超过 SSTABLESIZE
+    uint64_t inlineLen = top.valueLen() & INLINE_FLAG ? top.valueLen() & ~INLINE_FLAG : 0;
+    if (!out.keys.empty() && SSTable::tableSize(out.keys.size() + 1, out.inlineData.size() + inlineLen, bloomSize,
+                                                hashIndex) > SSTABLESIZE) {
+        finishOutput(job, out);
+    }
+    if (out.keys.empty()) {
+        out.bloom = new bloomFilter(bloomSize, BLOOMHASHNUM);
+        out.min_key = MINKEY;
+        out.max_key = 0;
+    }
+    uint64_t key = top.key();
+    out.min_key = std::min(out.min_key, key);
+    out.max_key = std::max(out.max_key, key);
+    out.keys.push_back(key);
+    if (top.valueLen() & INLINE_FLAG) {
+        // 内联的值复制到本文件的内联区，偏移量改为在本文件中的位置
+        out.offsets.push_back(out.inlineData.size());
+        out.inlineData += top.sst->inlineValueAt(top.pos);
+    } else {
+        out.offsets.push_back(top.offset());
+    }
+    out.valueLens.push_back(top.valueLen());
+    out.bloom->insert(key);
 }
 
-void
-KVStore::getPairsFromMemTable(uint64_t key1, uint64_t key2, std::vector <std::vector<std::pair < uint64_t, std::string>>
-
-> & scanRes,
-std::vector<int> &it, std::priority_queue<kv>
-& kvs )
-{
-scanRes.
-push_back( memTable
-->
-scan( key1, key2
-));
-it.push_back( 0 );
-if ( it.
-
-back()
-
-!= scanRes.
-
-back()
-
-.
-
-size()
-
-)
-{
-kvs.
-push( kv{scanRes.back()[0], stamp, 0}
-);
-it.
-
-back()
-
-++;
-}
+void KVStore::finishOutput(compaction_job &job, output_builder &out) {
+    if (out.keys.empty()) {
+        return;
+    }
+    // 新文件先使用选取时定下的临时编号，安装完成后再统一重新编号
+    uint64_t kv_num = out.keys.size();
+    SSTable *sst = new SSTable({job.new_stamp, kv_num, out.max_key, out.min_key}, job.level + 1,
+                               job.next_id++, out.bloom, std::move(out.keys), std::move(out.offsets),
+                               std::move(out.valueLens), dir_path, vlog, std::move(out.inlineData), hashIndex);
+    rateLimiter->request(sst->diskSize(), IO_LOW);
+    sst->write_disk();
+    sst->sync_disk();
+    job.outputs.push_back(sst);
+    job.stats.output_files++;
+    job.stats.output_entries += kv_num;
+    job.stats.bytes_written += sst->diskSize();
+    out.keys.clear();
+    out.offsets.clear();
+    out.valueLens.clear();
+    out.inlineData.clear();
 }
 
-void
-KVStore::getPairsFromSSTable(uint64_t key1, uint64_t key2, std::vector <std::vector<std::pair < uint64_t, std::string>>
-
->& scanRes,
-std::vector<int> &it, std::priority_queue<kv>
-& kvs) {
-int sstSum = 0;
-for (
-auto &layer
-: layers) {
-for (
-auto &sstable
-: layer) {
-scanRes.
-push_back(sstable
-->
-scan(key1, key2
-));
-it.push_back(0);
-if (it.
-
-back()
-
-!= scanRes.
-
-back()
-
-.
-
-size()
-
-) {
-kvs.
-push(kv{scanRes.back()[0], sstable->getStamp(), sstSum + (&sstable - &layer[0]) + 1}
-);
-it.
-
-back()
-
-++;
-}
+void KVStore::process_vlog() {
+    // 从第一个有数据的块开始，找到第一个校验和正确的条目作为 tail
+    tail = vlog->seekData();
+    vlog_header header;
+    std::string value;
+    while (tail < (uint64_t) vlog->end()) {
+        if (vlog->readHeader(tail, header) && tail + VLOGPADDING + header.valueLen <= (uint64_t) vlog->end()) {
+            value.resize(header.valueLen);
+            vlog->read(tail + VLOGPADDING, header.valueLen, &value[0]);
+            if (utils::generate_checksum(header.key, header.valueLen, value) == header.checkSum) {
+                break;
+            }
+        }
+        tail++;
+    }
 }
-sstSum += layer.
-
-size();
 
-}
+uint64_t KVStore::scanPriority(int level, const SSTable *sst) const {
+    // 同一个键以更新的版本为准：内存表 > 第 0 层 > 第 1 层 > 第 2 层 ...，同一层内按时间戳（第 0 层和分层合并时同层会重叠）。
+    // 时间戳远小于 2^40，层号放在高位
+    return ((uint64_t) (layers.size() - level) << 40) + sst->getStamp();
 }
 
-int KVStore::determineCompactSize(int level, uint64_t& min_key, uint64_t& max_key, uint64_t& max_stamp) {
+void KVStore::determineInputs(int level, std::vector<int>& upperIndex, uint64_t& min_key, uint64_t& max_key, int seekIndex) {
     min_key = MINKEY;
     max_key = 0;
-    int compact_size = level ? layers[level].size() / 2 : layers[level].size();
-    max_stamp = layers[level][compact_size - 1]->getStamp();
-    while (compact_size < layers[level].size() && layers[level][compact_size]->getStamp() <= max_stamp) {
-        compact_size++;
+    // 第 0 层的文件互相重叠，全部参与合并；分层合并时取最旧的 TIER_RUNS 个段，同层的段都由上一层同样多的段合并而来，大小相近；
+    // 其余情况只取与下一层重叠比例最小的一个文件。seekIndex 是点查触发合并的文件：分层合并时取到它所在的段为止
+    // （必须是本层最旧的一段前缀，下一层才总比本层旧），分级合并时只取它
+    upperIndex.clear();
+    if (level == 0 || style == TIERED_COMPACTION) {
+        int end = level == 0 ? layers[0].size() : oldestRunsEnd(level, TIER_RUNS);
+        if (level && seekIndex != -1) {
+            end = seekIndex;
+            while (end < (int) layers[level].size() && layers[level][end]->getStamp() == layers[level][seekIndex]->getStamp()) {
+                end++;
+            }
+        }
+        for (int i = 0; i < end; i++) {
+            upperIndex.push_back(i);
+        }
+    } else {
+        upperIndex.push_back(seekIndex == -1 ? pickInputFile(level) : seekIndex);
     }
-    return compact_size;
+    updateMinMaxKeys(upperIndex, min_key, max_key, level);
 }
 
 void KVStore::prepareNextLevel(int level) {
@@ -307,103 +309,156 @@ void KVStore::prepareNextLevel(int level) {
     }
 }
 
-//void KVStore::collectOverlappingSSTables(int level, uint64_t min_key, uint64_t max_key, std::vector<int>& index, std::vector<int>& it) {
-//    for (int i = 0; i < layers[level + 1].size(); i++) {
-//        if (layers[level + 1][i]->get_minkey() <= max_key && layers[level + 1][i]->get_maxkey() >= min_key) {
-//            index.push_back(i);
-//            it.push_back(0);
-//        }
-//    }
-//}
-
-void KVStore::mergeAndWriteSSTables(int level, int compact_size, std::vector<int>& index, std::vector<int>& it) {
-    std::priority_queue <kv_info> kvs;
-    for (auto &index_i : index) {
-        int i = index_i;
-        if (it[i] != layers[level + 1][i]->get_numkv()) {
-            SSTable *sst = layers[level + 1][i];
-            kvs.push(kv_info{sst->get_keys()[0], sst->get_valueLens()[0], sst->getStamp(), sst->get_offsets()[0], i});
-            it[i]++;
+uint64_t KVStore::countEntries(const compaction_job &job, uint64_t lo, uint64_t hi, bool last) const {
+    uint64_t count = 0;
+    for (const std::vector<SSTable *> *tables: {&job.upper, &job.lower}) {
+        for (const SSTable *sst: *tables) {
+            count += (last ? sst->get_numkv() : sst->lowerBound(hi)) - sst->lowerBound(lo);
         }
     }
-    for (int i = 0; i < compact_size; i++) {
-        it.push_back(0);
-        if (it.back() != layers[level][i]->get_numkv()) {
-            SSTable *sst = layers[level][i];
-            kvs.push(kv_info{sst->get_keys()[0], sst->get_valueLens()[0], sst->getStamp(), sst->get_offsets()[0],
-                             i + index.size()});
-            it.back()++;
+    return count;
+}
+
+std::vector<uint64_t> KVStore::splitCompaction(const compaction_job &job) const {
+    // 返回各个键范围的起点，第一个是 0。候选边界是下一层各个 SSTable 的最小键（下一层没有输入时用本层的），
+    // 切在下一层文件的边界上，每个范围写出的文件与下一层原来的文件大致对齐；按输入条目数尽量均分
+    std::vector<uint64_t> candidates;
+    for (const SSTable *sst: job.lower.empty() ? job.upper : job.lower) {
+        candidates.push_back(sst->get_minkey());
+    }
+    std::sort(candidates.begin(), candidates.end());
+    candidates.erase(std::unique(candidates.begin(), candidates.end()), candidates.end());
+    uint64_t total = countEntries(job, 0, 0, true);
+    uint64_t slices = std::min((uint64_t) subcompactions, total / SUBCOMPACTION_MIN_ENTRIES);
+    std::vector<uint64_t> bounds{0};
+    for (uint64_t key: candidates) {
+        if (bounds.size() >= slices) {
+            break;
+        }
+        if (key > bounds.back() && countEntries(job, 0, key, false) >= total * bounds.size() / slices) {
+            bounds.push_back(key);
         }
     }
+    return bounds;
+}
 
-    std::vector <kv_info> kv_list;
-    while (!kvs.empty()) {
-        kv_info min_kv = kvs.top();
-        kvs.pop();
-        if (kv_list.empty() || min_kv.key != kv_list.back().key) {
-            kv_list.push_back(min_kv);
-        } else {
-            assert(kv_list.back().stamp >= min_kv.stamp);
+void KVStore::mergeRange(compaction_job &job, uint64_t lo, uint64_t hi, bool last) {
+    // 下一层的键总是比本层旧：下一层的游标优先级为 0，同键时本层的版本先输出。只归并 [lo, hi) 中的键，last 时没有上界
+    std::vector<TableCursor> cursors;
+    for (SSTable *sst: job.lower) {
+        cursors.push_back({sst, nullptr, 0, sst->lowerBound(lo), 1});
+    }
+    for (SSTable *sst: job.upper) {
+        cursors.push_back({sst, nullptr, sst->getStamp(), sst->lowerBound(lo), 1});
+    }
+
+    // 边归并边切分输出文件，每个键只保留最新的版本；写入最底层时最新的版本是删除标记就整个键都不再输出
+    output_builder out;
+    MergingIterator<TableCursor> merger(std::move(cursors));
+    bool first = true;
+    uint64_t lastKey = 0;
+    for (; merger.valid() && (last || merger.key() < hi); merger.next()) {
+        job.stats.input_entries++;
+        if (!first && merger.key() == lastKey) {
+            job.stats.dropped_versions++;
+            continue;
         }
-        if (min_kv.i >= index.size()) {
-            int i = min_kv.i - index.size();
-            if (it[min_kv.i] != layers[level][i]->get_numkv()) {
-                SSTable *sst = layers[level][i];
-                kvs.push(kv_info{sst->get_keys()[it[min_kv.i]], sst->get_valueLens()[it[min_kv.i]], min_kv.stamp,
-                                 sst->get_offsets()[it[min_kv.i]], min_kv.i});
-                it[min_kv.i]++;
-            }
-        } else if (it[min_kv.i] != layers[level + 1][index[min_kv.i]]->get_numkv()) {
-            SSTable *sst = layers[level + 1][index[min_kv.i]];
-            kvs.push(kv_info{sst->get_keys()[it[min_kv.i]], sst->get_valueLens()[it[min_kv.i]], min_kv.stamp,
-                             sst->get_offsets()[it[min_kv.i]], min_kv.i});
-            it[min_kv.i]++;
+        first = false;
+        lastKey = merger.key();
+        if (job.bottommost && !merger.top().valueLen()) {
+            job.stats.dropped_tombstones++;
+            continue;
         }
+        addToOutput(job, out, merger.top());
     }
-    for (auto it = index.rbegin(); it != index.rend(); ++it) {
-        auto iter = layers[level + 1].begin() + *it;
-        (*iter)->delete_disk();
-        delete *iter;
-        layers[level + 1].erase(iter);
+    finishOutput(job, out);
+}
+
+void KVStore::mergeAndWriteSSTables(compaction_job &job) {
+    // 只访问 job 中记下的 SSTable，不读取 layers，运行期间不需要持有 versionLock
+    job.new_stamp = 0;
+    for (const std::vector<SSTable *> *tables: {&job.upper, &job.lower}) {
+        for (const SSTable *sst: *tables) {
+            job.new_stamp = std::max(job.new_stamp, sst->getStamp());
+        }
     }
 
-    for (auto it = layers[level].rbegin(); it != layers[level].rend(); ++it) {
-        (*it)->delete_disk();
-        delete *it;
+    // 各个键范围在自己的线程上归并，第一个范围用当前线程。每个范围的输出文件数不超过它的条目数除以单个文件
+    // 最少能放下的条目数（每个条目都带最长的内联值，哈希索引每个条目最多占 4 个槽），据此预先分配互不冲突的临时编号
+    std::vector<uint64_t> bounds = splitCompaction(job);
+    std::vector<compaction_job> slices(bounds.size(), job);
+    std::vector<std::thread> workers;
+    uint64_t perTable = (SSTABLESIZE - bloomSize - HEADERSIZE - sizeof(uint32_t)) /
+                        (KOVSIZE + INLINE_THRESHOLD + 4 * sizeof(uint32_t));
+    for (size_t s = 0; s < slices.size(); s++) {
+        bool last = s + 1 == slices.size();
+        uint64_t hi = last ? 0 : bounds[s + 1];
+        slices[s].stats = compaction_stats{};
+        slices[s].next_id = job.next_id;
+        job.next_id += (countEntries(job, bounds[s], hi, last) + perTable - 1) / perTable;
+        if (s) {
+            workers.emplace_back(&KVStore::mergeRange, this, std::ref(slices[s]), bounds[s], hi, last);
+        }
+    }
+    mergeRange(slices[0], bounds[0], slices.size() > 1 ? bounds[1] : 0, slices.size() == 1);
+    for (auto &worker: workers) {
+        worker.join();
     }
-    layers[level].clear();
 
-    int id1 = 0;
-    for (auto &layer : layers[level]) {
-        layer->set_id(id1++);
+    // 各范围的输出按键的顺序拼接，一起安装
+    for (const compaction_job &slice: slices) {
+        job.outputs.insert(job.outputs.end(), slice.outputs.begin(), slice.outputs.end());
+        job.stats.output_files += slice.stats.output_files;
+        job.stats.input_entries += slice.stats.input_entries;
+        job.stats.output_entries += slice.stats.output_entries;
+        job.stats.dropped_versions += slice.stats.dropped_versions;
+        job.stats.dropped_tombstones += slice.stats.dropped_tombstones;
+        job.stats.bytes_written += slice.stats.bytes_written;
     }
+    job.stats.subcompactions = slices.size();
+    // 所有输出落盘后再刷一次目录，安装时才能删除输入文件
+    utils::sync_file(dir_path);
+}
 
-    int id2 = 0;
-    for (auto &layer : layers[level + 1]) {
-        layer->set_id(id2++);
+void KVStore::installCompaction(compaction_job &job) {
+    // 调用者持有 versionLock 的独占锁。新的 SSTable 已经写出，再删除参与合并的旧文件；
+    // 合并期间第 0 层只会在末尾追加新文件，job 中的下标仍然有效
+    int level = job.level;
+    std::vector<SSTable *> &outputs = job.outputs;
+    int pos = job.index.empty() ? -1 : job.index[0];
+    if (job.trivial) {
+        // 输入文件原样移到下一层：只从本层摘下并重命名。不刷目录，崩溃后文件无论落在哪一层，
+        // 它们与下一层和彼此都不重叠，恢复出的结果都正确
+        for (auto idx = job.upperIndex.rbegin(); idx != job.upperIndex.rend(); ++idx) {
+            layers[level].erase(layers[level].begin() + *idx);
+        }
+        outputs = job.upper;
+        std::sort(outputs.begin(), outputs.end(), [](const SSTable *a, const SSTable *b) {
+            return a->get_minkey() < b->get_minkey();
+        });
+        for (SSTable *sst: outputs) {
+            sst->set_level(level + 1, job.next_id++);
+            // 换了一层，之前累计的白白探测次数不再说明它在新位置上的情况，否则下一次探测又会把它选成候选
+            sst->resetWastedProbes();
+        }
+    } else {
+        deleteOldSSTables(level, job.upperIndex, job.index);
     }
 
-    int max_kvnum = (SSTABLESIZE - bloomSize - HEADERSIZE) / 20;
-    for (int i = 0; i < kv_list.size(); i += max_kvnum) {
-        uint64_t max_key = 0;
-        uint64_t min_key = MINKEY;
-        uint64_t new_step = 0;
-        uint64_t kv_num = std::min(max_kvnum, (int) kv_list.size() - i);
-        std::vector <uint64_t> keys;
-        std::vector <uint64_t> offsets, valueLens;
-        bloomFilter *bloom_p = new bloomFilter(bloomSize, 3);
-        for (int j = i; j < std::min(i + max_kvnum, (int) kv_list.size()); j++) {
-            max_key = std::max(max_key, kv_list[j].key);
-            min_key = std::min(min_key, kv_list[j].key);
-            new_step = std::max(new_step, kv_list[j].stamp);
-            keys.push_back(kv_list[j].key);
-            offsets.push_back(kv_list[j].offset);
-            valueLens.push_back(kv_list[j].valueLen);
-            bloom_p->insert(kv_list[j].key);
+    // 新文件放在下一层中按键有序的位置上，保持第 1 层及以下互不重叠；
+    // 分层合并时输出是下一层最新的段，放在末尾
+    if (style == TIERED_COMPACTION) {
+        pos = layers[level + 1].size();
+    } else if (pos == -1) {
+        pos = 0;
+        while (!outputs.empty() && pos < (int) layers[level + 1].size() &&
+               layers[level + 1][pos]->get_minkey() < outputs[0]->get_minkey()) {
+            pos++;
         }
-        SSTable *sst = new SSTable({new_step, kv_num, max_key, min_key}, level + 1, layers[level + 1].size(), bloom_p,
-                                   keys, offsets, valueLens, dir_path, vlog_path);
-        sst->write_disk();
-        layers[level + 1].push_back(sst);
     }
-}
\ No newline at end of file
+    layers[level + 1].insert(layers[level + 1].begin() + pos, outputs.begin(), outputs.end());
+
+    updateSSTableIndices(level);
+    rebuildFences(level);
+    rebuildFences(level + 1);
+}
@@ -6,6 +6,7 @@ MemTable::MemTable(double p, uint64_t bloomSize) {
     this->bloomSize = bloomSize;
     max_layer = 1;
     num_kv = 0;
+    inlineBytes = 0;
     rand_double = std::uniform_real_distribution<double>(0, 1);
     //初始化头节点
     head.push_back(new Node(HEAD, "NONE", nullptr, nullptr));
@@ -52,6 +53,7 @@ void MemTable::put(uint64_t key, const std::string &val) {
         former[layer - 1] = ptr;
         //如果找到一个节点的键等于 key，则更新该节点及其下层节点的值，并返回
         if (ptr->key == key) {
+            inlineBytes = inlineBytes - inlineLength(ptr->value) + inlineLength(val);
             while (ptr) ptr->value = val, ptr = ptr->down;
             return;
         }
@@ -62,6 +64,7 @@ void MemTable::put(uint64_t key, const std::string &val) {
     }
     //增加键值对的数量
     num_kv++;
+    inlineBytes += inlineLength(val);
     //调用 getlayer 函数确定新节点的层数
     int new_layer = getlayer();
     //在每一层中插入新节点，更新指针
@@ -79,6 +82,10 @@ void MemTable::put(uint64_t key, const std::string &val) {
     max_layer = std::max(max_layer, new_layer);
 }
 
+uint64_t MemTable::inlineLength(const std::string &val) {
+    return val != "~DELETED~" && val.length() < INLINE_THRESHOLD ? val.length() : 0;
+}
+
 int MemTable::getlayer() {
     int layer = 1;
     while (rand_double(randSeed) < p) {
@@ -114,14 +121,44 @@ std::string MemTable::get(uint64_t key) const {
 }
 
 
+void MemTable::get(const std::vector<uint64_t> &keys, std::vector<std::string> &vals) const {
+    vals.assign(keys.size(), "");
+    //finger[layer - 1] 记录上一个键在每一层停下的节点，keys 升序时可以直接从这里继续向后
+    std::vector<MemTable::Node *> finger(head.begin(), head.begin() + max_layer);
+    for (size_t i = 0; i < keys.size(); i++) {
+        assert(i == 0 || keys[i - 1] <= keys[i]);
+        MemTable::Node *ptr = finger[max_layer - 1];
+        for (int layer = max_layer; layer; layer--) {
+            while (ptr->next && ptr->next->key <= keys[i]) {
+                ptr = ptr->next;
+            }
+            finger[layer - 1] = ptr;
+            if (ptr != head[layer - 1] && ptr->key == keys[i]) {
+                vals[i] = ptr->value;
+                break;
+            }
+            if (layer > 1) {
+                //下一层从 ptr->down 与上一次停下的节点中更靠后的那个开始
+                MemTable::Node *down = ptr->down;
+                MemTable::Node *last = finger[layer - 2];
+                if (down == head[layer - 2] || (last != head[layer - 2] && last->key > down->key)) {
+                    down = last;
+                }
+                ptr = down;
+            }
+        }
+    }
+}
+
+
 std::vector<std::pair<uint64_t, std::string>> MemTable::scan(uint64_t key1, uint64_t key2) const {
     Node* start = findStartPosition(key1);
     return collectRange(start, key1, key2);
 }
 
 
-int MemTable::size() {
-    return HEADERSIZE + bloomSize + num_kv * KOVSIZE;
+int MemTable::size(bool withHashIndex) {
+    return SSTable::tableSize(num_kv, inlineBytes, bloomSize, withHashIndex);
 }
 
 
@@ -129,28 +166,34 @@ int MemTable::get_numkv() {
     return num_kv;
 }
 
-SSTable *MemTable::convertSSTable(int id, uint64_t stamp, const std::string &dir, const std::string &vlog) {
+
+uint64_t MemTable::get_inlinebytes() const {
+    return inlineBytes;
+}
+
+SSTable *MemTable::convertSSTable(int id, uint64_t stamp, const std::string &dir, VLog *vlog, bool withHashIndex) {
     off_t offset;
-    int fd;
     uint64_t max_k = 0;
     uint64_t min_k = MINKEY;
     std::vector <uint64_t> keys, offsets, valueLens;
+    std::string inlineData;
     bloomFilter *bloom_p;
 
-    initializeConversion(vlog, offset, fd, keys, offsets, valueLens, bloom_p);
-    processNodes(fd, offset, keys, offsets, valueLens, bloom_p, max_k, min_k);
+    initializeConversion(vlog, offset, keys, offsets, valueLens, bloom_p);
+    processNodes(vlog, offset, keys, offsets, valueLens, inlineData, bloom_p, max_k, min_k);
     SSTable *sst;
-    finalizeConversion(fd, sst, id, stamp, dir, vlog, bloom_p, keys, offsets, valueLens, max_k, min_k);
+    finalizeConversion(sst, id, stamp, dir, vlog, bloom_p, keys, offsets, valueLens, inlineData, max_k, min_k,
+                       withHashIndex);
 
     return sst;
 }
 
 
-void MemTable::write_vlog(Node *p, off_t &offset, int fd) {
+void MemTable::write_vlog(Node *p, off_t &offset, VLog *vlog) {
     size_t vlog_len = p->value.length() + VLOGPADDING;
     char buf[vlog_len + 5];
     prepareBuffer(p, buf, vlog_len);
-    writeBuffer(fd, buf, vlog_len); // 传递 char* 类型的指针
+    writeBuffer(vlog, buf, vlog_len);
     offset += vlog_len;
 }
 
@@ -23,6 +23,7 @@ private:
     uint64_t bloomSize;
     int max_layer;
     int num_kv;
+    uint64_t inlineBytes;//转储时写入 SSTable 内联区的字节数
 
     struct Node {
         uint64_t key;
@@ -45,26 +46,32 @@ private:
     std::uniform_real_distribution<double> rand_double;
 
     //将节点写入 vlog 文件
-    void write_vlog(Node *p, off_t &offset, int fd);
+    void write_vlog(Node *p, off_t &offset, VLog *vlog);
 
     //获取新节点的层数
     int getlayer();
 
-    void initializeConversion(const std::string &vlog, off_t &offset, int &fd, std::vector <uint64_t> &keys,
+    //转储时这个值占用的内联区字节数，写入 vlog 的值和删除标记为 0
+    static uint64_t inlineLength(const std::string &val);
+
+    void initializeConversion(VLog *vlog, off_t &offset, std::vector <uint64_t> &keys,
                               std::vector <uint64_t> &offsets, std::vector <uint64_t> &valueLens,
                               bloomFilter *&bloom_p);
 
-    void processNodes(int fd, off_t &offset, std::vector <uint64_t> &keys, std::vector <uint64_t> &offsets,
-                      std::vector <uint64_t> &valueLens, bloomFilter *bloom_p, uint64_t &max_k, uint64_t &min_k);
+    //短于 INLINE_THRESHOLD 的值追加到 inlineData，不写入 vlog
+    void processNodes(VLog *vlog, off_t &offset, std::vector <uint64_t> &keys, std::vector <uint64_t> &offsets,
+                      std::vector <uint64_t> &valueLens, std::string &inlineData, bloomFilter *bloom_p,
+                      uint64_t &max_k, uint64_t &min_k);
 
     void
-    finalizeConversion(int fd, SSTable *&sst, int id, uint64_t stamp, const std::string &dir, const std::string &vlog,
+    finalizeConversion(SSTable *&sst, int id, uint64_t stamp, const std::string &dir, VLog *vlog,
                        bloomFilter *bloom_p, const std::vector <uint64_t> &keys, const std::vector <uint64_t> &offsets,
-                       const std::vector <uint64_t> &valueLens, uint64_t max_k, uint64_t min_k);
+                       const std::vector <uint64_t> &valueLens, std::string &inlineData, uint64_t max_k,
+                       uint64_t min_k, bool withHashIndex);
 
     void prepareBuffer(Node *p, char *buf, size_t vlog_len);
 
-    void writeBuffer(int fd, char *buf, size_t vlog_len); // 修改参数类型为 char*
+    void writeBuffer(VLog *vlog, char *buf, size_t vlog_len);
     uint16_t generateChecksum(uint64_t key, const std::string &value);
 
 
@@ -97,17 +104,23 @@ public:
     //获取指定键对应的值
     std::string get(uint64_t key) const;
 
+    //按升序批量获取多个键的值，每个键从上一个键停下的位置继续查找
+    void get(const std::vector<uint64_t> &keys, std::vector<std::string> &vals) const;
+
     //扫描指定键范围内的所有键值对，并返回一个包含这些键值对的向量
     std::vector <std::pair<uint64_t, std::string>> scan(uint64_t key1, uint64_t key2) const;
 
-    //获取一个sstable大小
-    int size();
+    //获取一个sstable大小，withHashIndex 表示转储时建立哈希索引
+    int size(bool withHashIndex);
 
     //获取键值对数量
     int get_numkv();
 
+    //转储时内联区的字节数
+    uint64_t get_inlinebytes() const;
+
     //将 memtable 转换为 sstable
-    SSTable *convertSSTable(int id, uint64_t stamp, const std::string &dir, const std::string &vlog);
+    SSTable *convertSSTable(int id, uint64_t stamp, const std::string &dir, VLog *vlog, bool withHashIndex);
 };
 
 #endif //MEMTABLE_H
\ No newline at end of file
@@ -2,39 +2,44 @@
 
 #include "memtable.h"
 
-void MemTable::initializeConversion(const std::string &vlog, off_t &offset, int &fd, std::vector<uint64_t> &keys, std::vector<uint64_t> &offsets, std::vector<uint64_t> &valueLens, bloomFilter *&bloom_p) {
-    offset = (off_t) utils::get_end_offset(vlog);
-    bloom_p = new bloomFilter(bloomSize, 3);
-    fd = open(vlog.c_str(), O_RDWR | O_CREAT | O_APPEND, 0644);
-    lseek(fd, offset, SEEK_SET);
+void MemTable::initializeConversion(VLog *vlog, off_t &offset, std::vector<uint64_t> &keys, std::vector<uint64_t> &offsets, std::vector<uint64_t> &valueLens, bloomFilter *&bloom_p) {
+    offset = vlog->end();
+    bloom_p = new bloomFilter(bloomSize, BLOOMHASHNUM);
 }
 
-void MemTable::processNodes(int fd, off_t &offset, std::vector<uint64_t> &keys, std::vector<uint64_t> &offsets, std::vector<uint64_t> &valueLens, bloomFilter *bloom_p, uint64_t &max_k, uint64_t &min_k) {
+void MemTable::processNodes(VLog *vlog, off_t &offset, std::vector<uint64_t> &keys, std::vector<uint64_t> &offsets, std::vector<uint64_t> &valueLens, std::string &inlineData, bloomFilter *bloom_p, uint64_t &max_k, uint64_t &min_k) {
     MemTable::Node *ptr = head[0];
     while (ptr->next) {
         MemTable::Node *p = ptr->next;
         bloom_p->insert(p->key);
         keys.push_back(p->key);
-        offsets.push_back(offset);
-        if (p->value != "~DELETED~") {
-            if (p->key > max_k) {
-                max_k = p->key;
-            }
-            if (p->key < min_k) {
-                min_k = p->key;
-            }
-            valueLens.push_back(p->value.length());
-            write_vlog(p, offset, fd);
-        } else {
+        // 删除标记也计入键范围，否则合并时无法找到与之重叠的 SSTable
+        if (p->key > max_k) {
+            max_k = p->key;
+        }
+        if (p->key < min_k) {
+            min_k = p->key;
+        }
+        if (p->value == "~DELETED~") {
+            offsets.push_back(offset);
             valueLens.push_back(0);
+        } else if (p->value.length() < INLINE_THRESHOLD) {
+            // 小值内联存放，偏移量是在内联区中的位置
+            offsets.push_back(inlineData.size());
+            valueLens.push_back(p->value.length() | INLINE_FLAG);
+            inlineData += p->value;
+        } else {
+            offsets.push_back(offset);
+            valueLens.push_back(p->value.length());
+            write_vlog(p, offset, vlog);
         }
         ptr = ptr->next;
     }
 }
 
-void MemTable::finalizeConversion(int fd, SSTable *&sst, int id, uint64_t stamp, const std::string &dir, const std::string &vlog, bloomFilter *bloom_p, const std::vector<uint64_t> &keys, const std::vector<uint64_t> &offsets, const std::vector<uint64_t> &valueLens, uint64_t max_k, uint64_t min_k) {
-    close(fd);
-    sst = new SSTable({stamp, num_kv, max_k, min_k}, 0, id, bloom_p, keys, offsets, valueLens, dir, vlog);
+void MemTable::finalizeConversion(SSTable *&sst, int id, uint64_t stamp, const std::string &dir, VLog *vlog, bloomFilter *bloom_p, const std::vector<uint64_t> &keys, const std::vector<uint64_t> &offsets, const std::vector<uint64_t> &valueLens, std::string &inlineData, uint64_t max_k, uint64_t min_k, bool withHashIndex) {
+    sst = new SSTable({stamp, num_kv, max_k, min_k}, 0, id, bloom_p, keys, offsets, valueLens, dir, vlog,
+                      std::move(inlineData), withHashIndex);
     sst->write_disk();
 }
 
@@ -47,8 +52,8 @@ void MemTable::prepareBuffer(Node *p, char* buf, size_t vlog_len) {
     *(uint32_t * )(buf + 11) = (uint32_t) p->value.length();
 }
 
-void MemTable::writeBuffer(int fd, char* buf, size_t vlog_len) { // 修改参数类型为 char*
-    utils::write_file(fd, vlog_len, static_cast<void*>(buf)); // 显式类型转换为 void*
+void MemTable::writeBuffer(VLog *vlog, char* buf, size_t vlog_len) {
+    vlog->append(buf, vlog_len);
 }
 
 uint16_t MemTable::generateChecksum(uint64_t key, const std::string &value) {
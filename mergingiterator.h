@@ -0,0 +1,123 @@
+#ifndef MERGINGITERATOR_H
+#define MERGINGITERATOR_H
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <utility>
+#include <algorithm>
+
+//基于败者树的多路归并。Child 需要提供 valid()、next()、key() 和 priority()：
+//正向时键小的先输出（reverse 时键大的先输出），键相同时 priority 大的（更新的版本）先输出，这里不做去重。
+//每个子迭代器当前的键缓存在树旁边，每次 next() 只沿着一条叶子到根的路径比较 log2(k) 次，子迭代器原地移动，不复制任何条目
+template<typename Child>
+class MergingIterator {
+
+private:
+    //比较用的条目缓存：逆序时存 ~key，tie 存 ~priority，两个字段都是越小越先输出
+    struct Head {
+        uint64_t key;
+        uint64_t tie;
+        bool done;
+    };
+
+    std::vector<Child> children;
+    std::vector<Head> heads; //每个子迭代器当前条目的缓存
+    std::vector<int> tree; //tree[0] 是胜者，tree[1..k-1] 存放各个内部结点上的败者
+    bool reverse;
+
+    int size() const { return (int) children.size(); }
+
+    void load(int i) {
+        const Child &child = children[i];
+        heads[i].done = !child.valid();
+        if (!heads[i].done) {
+            heads[i].key = reverse ? ~child.key() : child.key();
+            heads[i].tie = ~child.priority();
+        }
+    }
+
+    //a 是否胜过 b，已经耗尽的子迭代器总是输
+    bool beats(int a, int b) const {
+        const Head &x = heads[a];
+        const Head &y = heads[b];
+        if (x.done | y.done) {
+            return !x.done;
+        }
+        return (x.key < y.key) | ((x.key == y.key) & (x.tie < y.tie));
+    }
+
+    //叶子 s 的条目改变后，沿到根的路径重新比赛
+    void adjust(int s) {
+        for (int t = (s + size()) / 2; t > 0; t /= 2) {
+            if (beats(tree[t], s)) {
+                std::swap(s, tree[t]);
+            }
+        }
+        tree[0] = s;
+    }
+
+public:
+    explicit MergingIterator(std::vector<Child> children, bool reverse = false)
+            : children(std::move(children)), reverse(reverse) {
+        build();
+    }
+
+    //更换方向，之后需要调用 build()
+    void setReverse(bool reverse) {
+        this->reverse = reverse;
+    }
+
+    //子迭代器被整体重新定位之后重新建树
+    void build() {
+        heads.resize(size());
+        for (int i = 0; i < size(); i++) {
+            load(i);
+        }
+        // 自底向上建树：结点 t 的两个孩子是 2t 和 2t+1，编号不小于 size() 的结点是叶子 t - size()
+        int k = size();
+        tree.assign(std::max(k, 1), 0);
+        std::vector<int> winner(2 * k);
+        for (int i = 0; i < k; i++) {
+            winner[k + i] = i;
+        }
+        for (int t = k - 1; t > 0; t--) {
+            int a = winner[2 * t], b = winner[2 * t + 1];
+            bool aWins = beats(a, b);
+            winner[t] = aWins ? a : b;
+            tree[t] = aWins ? b : a;
+        }
+        tree[0] = k > 1 ? winner[1] : 0;
+    }
+
+    bool valid() const {
+        return size() && !heads[tree[0]].done;
+    }
+
+    //当前输出的子迭代器
+    const Child &top() const {
+        return children[tree[0]];
+    }
+
+    int topIndex() const {
+        return tree[0];
+    }
+
+    uint64_t key() const {
+        return top().key();
+    }
+
+    void next() {
+        int s = tree[0];
+        children[s].next();
+        load(s);
+        adjust(s);
+    }
+
+    std::vector<Child> &getChildren() {
+        return children;
+    }
+};
+
+#endif //MERGINGITERATOR_H
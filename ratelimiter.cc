@@ -0,0 +1,61 @@
+#include "ratelimiter.h"
+
+RateLimiter::RateLimiter(uint64_t bytesPerSecond)
+        : bytesPerSecond(bytesPerSecond), last(std::chrono::steady_clock::now()), stats{} {
+    tokens = burst();
+}
+
+double RateLimiter::burst() const {
+    return (double) bytesPerSecond * RATE_LIMIT_BURST_MS / 1000;
+}
+
+void RateLimiter::refill() {
+    auto now = std::chrono::steady_clock::now();
+    double elapsed = std::chrono::duration<double>(now - last).count();
+    last = now;
+    tokens = std::min(burst(), tokens + elapsed * bytesPerSecond);
+}
+
+void RateLimiter::request(uint64_t bytes, io_priority priority) {
+    std::unique_lock<std::mutex> guard(lock);
+    if (priority == IO_HIGH) {
+        stats.high_bytes += bytes;
+    } else {
+        stats.low_bytes += bytes;
+    }
+    if (!bytesPerSecond) {
+        return;
+    }
+    refill();
+    if (priority == IO_LOW && tokens <= 0) {
+        auto start = std::chrono::steady_clock::now();
+        stats.waits++;
+        // 按当前速率等到透支还清；期间调整速率会唤醒这里重新计算
+        while (bytesPerSecond && tokens <= 0) {
+            cond.wait_for(guard, std::chrono::duration<double>((1 - tokens) / bytesPerSecond));
+            refill();
+        }
+        stats.wait_us += std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now() - start).count();
+    }
+    tokens -= bytes;
+}
+
+void RateLimiter::setBytesPerSecond(uint64_t bytesPerSecond) {
+    std::lock_guard<std::mutex> guard(lock);
+    // 先按旧速率结算已经过去的时间
+    refill();
+    this->bytesPerSecond = bytesPerSecond;
+    tokens = std::min(tokens, burst());
+    cond.notify_all();
+}
+
+uint64_t RateLimiter::getBytesPerSecond() const {
+    std::lock_guard<std::mutex> guard(lock);
+    return bytesPerSecond;
+}
+
+rate_limiter_stats RateLimiter::getStats() const {
+    std::lock_guard<std::mutex> guard(lock);
+    return stats;
+}
@@ -0,0 +1,56 @@
+#ifndef RATELIMITER_H
+#define RATELIMITER_H
+
+#pragma once
+
+#include <cstdint>
+#include <mutex>
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include "config.h"
+
+//后台 I/O 的优先级：转储在写入路径上持有独占锁，不能等；合并和 gc 可以让路
+enum io_priority {
+    IO_HIGH,
+    IO_LOW
+};
+
+struct rate_limiter_stats {
+    uint64_t high_bytes; // 高优先级请求的字节数
+    uint64_t low_bytes; // 低优先级请求的字节数
+    uint64_t waits; // 低优先级请求等待令牌的次数
+    uint64_t wait_us; // 低优先级请求等待的总时间（微秒）
+};
+
+//令牌桶限速器，所有后台 I/O 在读写之前申请字节数。令牌按速率持续补充，最多积累 RATE_LIMIT_BURST_MS 毫秒的量。
+//高优先级的请求立即放行，令牌不足时透支；低优先级的请求等到桶里有令牌（透支已经还清）才放行，再扣掉全部字节，
+//因此大请求不会饿死，长期速率也不会超过上限。速率为 0 表示不限速
+class RateLimiter {
+
+private:
+    mutable std::mutex lock;
+    std::condition_variable cond;
+    uint64_t bytesPerSecond;
+    double tokens; //可能为负，表示透支
+    std::chrono::steady_clock::time_point last; //上一次补充令牌的时间
+    rate_limiter_stats stats;
+
+    double burst() const;
+    void refill();
+
+public:
+    explicit RateLimiter(uint64_t bytesPerSecond);
+
+    //申请 bytes 字节的 I/O，低优先级时可能阻塞
+    void request(uint64_t bytes, io_priority priority);
+
+    //运行时调整速率，正在等待的请求按新速率重新计算等待时间
+    void setBytesPerSecond(uint64_t bytesPerSecond);
+
+    uint64_t getBytesPerSecond() const;
+
+    rate_limiter_stats getStats() const;
+};
+
+#endif //RATELIMITER_H
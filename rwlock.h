@@ -0,0 +1,94 @@
+#ifndef RWLOCK_H
+#define RWLOCK_H
+
+#pragma once
+
+#include <vector>
+#include <utility>
+#include <pthread.h>
+
+//写优先的读写锁，满足 SharedMutex 的要求，可以配合 std::shared_lock 和 std::unique_lock 使用。
+//有写者在等待时新的读者排队，连续不断的读不会饿死写入和合并结果的安装。
+//同一个线程已经持有读锁时再次加读锁只增加计数（例如持有迭代器的线程调用 get），不会因为排队的写者而死锁
+class RWLock {
+
+private:
+    pthread_rwlock_t rw;
+
+    //当前线程正在持有的读锁和各自的计数，计数归零时删除
+    static std::vector<std::pair<RWLock *, int>> &heldLocks() {
+        thread_local std::vector<std::pair<RWLock *, int>> held;
+        return held;
+    }
+
+    std::vector<std::pair<RWLock *, int>>::iterator findHeld() {
+        std::vector<std::pair<RWLock *, int>> &held = heldLocks();
+        auto it = held.begin();
+        while (it != held.end() && it->first != this) {
+            ++it;
+        }
+        return it;
+    }
+
+public:
+    RWLock() {
+        pthread_rwlockattr_t attr;
+        pthread_rwlockattr_init(&attr);
+        pthread_rwlockattr_setkind_np(&attr, PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
+        pthread_rwlock_init(&rw, &attr);
+        pthread_rwlockattr_destroy(&attr);
+    }
+
+    ~RWLock() {
+        pthread_rwlock_destroy(&rw);
+    }
+
+    RWLock(const RWLock &) = delete;
+
+    RWLock &operator=(const RWLock &) = delete;
+
+    void lock() {
+        pthread_rwlock_wrlock(&rw);
+    }
+
+    bool try_lock() {
+        return pthread_rwlock_trywrlock(&rw) == 0;
+    }
+
+    void unlock() {
+        pthread_rwlock_unlock(&rw);
+    }
+
+    void lock_shared() {
+        auto it = findHeld();
+        if (it != heldLocks().end()) {
+            it->second++;
+            return;
+        }
+        pthread_rwlock_rdlock(&rw);
+        heldLocks().push_back(std::make_pair(this, 1));
+    }
+
+    bool try_lock_shared() {
+        auto it = findHeld();
+        if (it != heldLocks().end()) {
+            it->second++;
+            return true;
+        }
+        if (pthread_rwlock_tryrdlock(&rw) != 0) {
+            return false;
+        }
+        heldLocks().push_back(std::make_pair(this, 1));
+        return true;
+    }
+
+    void unlock_shared() {
+        auto it = findHeld();
+        if (--it->second == 0) {
+            heldLocks().erase(it);
+            pthread_rwlock_unlock(&rw);
+        }
+    }
+};
+
+#endif //RWLOCK_H
@@ -3,24 +3,31 @@
 
 SSTable::SSTable(head_type head, int level, int id, bloomFilter *bloomFilter, std::vector <uint64_t> keys,
                  std::vector <uint64_t> offsets, std::vector <uint64_t> valueLens, std::string dir_path,
-                 std::string vlog_path) {
+                 VLog *vlog, std::string inlineData, bool withHashIndex) {
     this->head = head;
     this->level = level;
     this->id = id;
     this->bloomfilter = bloomFilter;
-    this->keys = keys;
-    this->offsets = offsets;
-    this->valueLens = valueLens;
+    this->keys = std::move(keys);
+    this->offsets = std::move(offsets);
+    this->valueLens = std::move(valueLens);
     this->dir_path = dir_path;
-    this->vlog_path = vlog_path;
+    this->vlog = vlog;
+    this->inlineData = std::move(inlineData);
+    this->wastedProbes = 0;
+    if (withHashIndex) {
+        buildHashIndex();
+    }
+    computeVlogBegin();
 }
 
 
-SSTable::SSTable(int level, int id, std::string sstFilename, std::string dir_path, std::string vlog_path, uint64_t bloomSize) {
+SSTable::SSTable(int level, int id, std::string sstFilename, std::string dir_path, VLog *vlog, uint64_t bloomSize) {
     this->level = level;
     this->id = id;
     this->dir_path = dir_path;
-    this->vlog_path = vlog_path;
+    this->vlog = vlog;
+    this->wastedProbes = 0;
     sstFilename = dir_path + "/" + sstFilename;
 
     // Open the file
@@ -39,8 +46,16 @@ SSTable::SSTable(int level, int id, std::string sstFilename, std::string dir_pat
     // Read key-value pairs
     readKeyValuePairs(fd);
 
+    // Read inline values
+    readInlineData(fd);
+
+    // Read the hash index if the file has one
+    readHashIndex(fd, bloomSize);
+
     // Close the file
     close(fd);
+
+    computeVlogBegin();
 }
 
 
@@ -51,12 +66,13 @@ SSTable::~SSTable() {
 
 
 std::string SSTable::get(uint64_t key) const {
-    auto iter = findKey(key);
-    if (iter != keys.end() && *iter == key) {
-        int index = int(iter - keys.begin());
+    int index = getKeyIndex(key);
+    if (index != -1) {
         off_t offset = offsets[index];
         size_t size = valueLens[index];
-        if (size) {
+        if (isInlineAt(index)) {
+            return inlineValueAt(index);
+        } else if (size) {
             return readValueFromVlog(offset, size);
         } else {
             return std::string("~DELETED~");
@@ -83,7 +99,9 @@ std::string SSTable::get_fromdisk(uint64_t key) const {
     size_t valueLen;
     if (findKeyInDisk(fd, key, offset, valueLen)) {
         close(fd);
-        if (valueLen) {
+        if (valueLen & INLINE_FLAG) {
+            return inlineData.substr(offset, valueLen & ~INLINE_FLAG);
+        } else if (valueLen) {
             return readValueFromVlog(offset, valueLen);
         } else {
             return std::string("~DELETED~");
@@ -109,6 +127,50 @@ uint64_t SSTable::get_offset(uint64_t key) const {
 
 
 
+bool SSTable::locate(uint64_t key, uint64_t &offset, uint64_t &valueLen, std::string *inlineValue) const {
+    int index = getKeyIndex(key);
+    if (index == -1) {
+        return false;
+    }
+    offset = offsets[index];
+    valueLen = valueLens[index];
+    if (inlineValue && isInlineAt(index)) {
+        *inlineValue = inlineValueAt(index);
+    }
+    return true;
+}
+
+
+int SSTable::lowerBound(uint64_t key) const {
+    return int(findKey(key) - keys.begin());
+}
+
+
+uint64_t SSTable::keyAt(int index) const {
+    return keys[index];
+}
+
+
+uint64_t SSTable::offsetAt(int index) const {
+    return offsets[index];
+}
+
+
+uint64_t SSTable::valueLenAt(int index) const {
+    return valueLens[index];
+}
+
+
+bool SSTable::isInlineAt(int index) const {
+    return valueLens[index] & INLINE_FLAG;
+}
+
+
+std::string SSTable::inlineValueAt(int index) const {
+    return inlineData.substr(offsets[index], valueLens[index] & ~INLINE_FLAG);
+}
+
+
 std::vector<std::pair<uint64_t, std::string>> SSTable::scan(uint64_t key1, uint64_t key2) {
     std::vector<std::pair<uint64_t, std::string>> list;
     if (key1 > key2) {
@@ -133,11 +195,26 @@ bool SSTable::query(uint64_t key) {
 }
 
 
+bool SSTable::query(const bloomHash &h) const {
+    return bloomfilter->query(h);
+}
+
+
+const bloomFilter *SSTable::getFilter() const {
+    return bloomfilter;
+}
+
+
 void SSTable::write_disk() const {
     write_sst();
 }
 
 
+void SSTable::sync_disk() const {
+    utils::sync_file(getSSTFilename());
+}
+
+
 void SSTable::delete_disk() const {
     std::string sstFilename = getSSTFilename();
     assertFileExists(sstFilename);
@@ -154,6 +231,51 @@ void SSTable::set_id(int new_id) {
 }
 
 
+void SSTable::set_level(int new_level, int new_id) {
+    std::string old_sst = getSSTFilename();
+    level = new_level;
+    id = new_id;
+    std::string new_sst = getSSTFilename();
+    assertFileExists(old_sst);
+    renameFile(old_sst, new_sst);
+}
+
+
+void SSTable::computeVlogBegin() {
+    vlogBegin = UINT64_MAX;
+    for (size_t i = 0; i < keys.size(); i++) {
+        if (valueLens[i] && !isInlineAt(i)) {
+            vlogBegin = std::min(vlogBegin, offsets[i]);
+        }
+    }
+}
+
+
+uint32_t SSTable::addWastedProbe() const {
+    return ++wastedProbes;
+}
+
+
+void SSTable::resetWastedProbes() const {
+    wastedProbes = 0;
+}
+
+
+uint64_t SSTable::getVlogBegin() const {
+    return vlogBegin;
+}
+
+
+time_t SSTable::modifiedTime() const {
+    return utils::file_mtime(getSSTFilename());
+}
+
+
+int SSTable::get_id() const {
+    return id;
+}
+
+
 void SSTable::write_sst() const {
     std::string sstFilename = getSSTFilename();
     int fd = open(sstFilename.c_str(), O_RDWR | O_CREAT, 0644);
@@ -164,6 +286,8 @@ void SSTable::write_sst() const {
     writeHeader(sstFilename);
     writeBloomFilter(sstFilename);
     writeKeyValuePairs(sstFilename);
+    writeInlineData(sstFilename);
+    writeHashIndex(sstFilename);
 
     close(fd);
 }
@@ -174,6 +298,24 @@ uint64_t SSTable::get_numkv() const {
 }
 
 
+uint64_t SSTable::diskSize() const {
+    uint64_t size = tableSize(head.num_kv, inlineData.size(), bloomfilter->getM(), false);
+    if (!hashIndex.empty()) {
+        size += (hashIndex.size() + 1) * sizeof(uint32_t);
+    }
+    return size;
+}
+
+
+uint64_t SSTable::tableSize(uint64_t numKeys, uint64_t inlineBytes, uint64_t bloomSize, bool withHashIndex) {
+    uint64_t size = HEADERSIZE + bloomSize + numKeys * KOVSIZE + inlineBytes;
+    if (withHashIndex) {
+        size += (hashIndexSlots(numKeys) + 1) * sizeof(uint32_t);
+    }
+    return size;
+}
+
+
 uint64_t SSTable::getStamp() const {
     return head.stamp;
 }
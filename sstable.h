@@ -5,12 +5,14 @@
 
 #include <vector>
 #include <string>
+#include <atomic>
 #include <sstream>
 #include <unistd.h>
 #include <fcntl.h>
 #include "bloomfilter.h"
 #include "utils.h"
 #include "config.h"
+#include "vlog.h"
 
 
 struct head_type {
@@ -31,13 +33,23 @@ private:
     std::vector <uint64_t> keys;
     std::vector <uint64_t> offsets;
     std::vector <uint64_t> valueLens;
+    std::string inlineData;//内联存放的小值，紧跟在键数组之后
+    std::vector <uint32_t> hashIndex;//开放寻址的哈希表，槽中存放条目下标加 1，0 表示空槽；为空表示没有哈希索引
     std::string dir_path;//SSTable 文件所在的目录
-    std::string vlog_path;//vlog 文件所在的目录路径
+    VLog *vlog;//vlog 文件，由 KVStore 持有
+    uint64_t vlogBegin;//条目引用的最小 vlog 偏移量，没有引用 vlog 时为 UINT64_MAX
+    mutable std::atomic<uint32_t> wastedProbes;//过滤器放行但没有找到键的点查次数，持有共享锁的读者并发累加
 
     void write_sst() const;//将 SSTable 写入磁盘
     void readHeader(int fd);
     void initializeBloomFilter(int fd, uint64_t bloomSize);
     void readKeyValuePairs(int fd);
+    void readInlineData(int fd);
+    void readHashIndex(int fd, uint64_t bloomSize);
+    void buildHashIndex();
+    static size_t hashIndexSlots(uint64_t numKeys);
+    void computeVlogBegin();
+    size_t hashSlot(uint64_t key) const;
     std::vector<uint64_t>::const_iterator findKey(uint64_t key) const;
     std::string readValueFromVlog(off_t offset, size_t size) const;
     std::string getSSTFilename() const;
@@ -49,20 +61,21 @@ private:
     void writeHeader(std::string sstFilename) const;
     void writeBloomFilter(std::string sstFilename) const;
     void writeKeyValuePairs(std::string fd) const;
+    void writeInlineData(std::string sstFilename) const;
+    void writeHashIndex(std::string sstFilename) const;
     void assertFileExists(const std::string& filename) const;
     void removeFile(const std::string& filename) const;
     void renameFile(const std::string& oldFilename, const std::string& newFilename) const;
 
 
 public:
-    //初始化 SSTable 的各个成员变量
+    //初始化 SSTable 的各个成员变量，inlineData 是带 INLINE_FLAG 的条目引用的内联值，withHashIndex 时建立哈希索引
     SSTable(head_type head, int level, int id, bloomFilter *bloomFilter, std::vector <uint64_t> keys,
             std::vector <uint64_t> offsets, std::vector <uint64_t> valueLens, std::string dir_path,
-            std::string vlog_path);
+            VLog *vlog, std::string inlineData = "", bool withHashIndex = false);
 
     //从磁盘读取 SSTable 的数据并初始化成员变量
-    SSTable(int level, int id, std::string sstFilename, std::string dir_path, std::string vlog_path,
-            uint64_t bloomSize);
+    SSTable(int level, int id, std::string sstFilename, std::string dir_path, VLog *vlog, uint64_t bloomSize);
 
     //析构函数
     ~SSTable();
@@ -76,21 +89,70 @@ public:
     //获取键对应的偏移量
     uint64_t get_offset(uint64_t key) const;
 
+    //只查内存中的索引，不读取 vlog：找到键时返回 true，并给出值在 vlog 中的偏移量和长度（长度为 0 表示已删除）；
+    //值内联存放时长度带 INLINE_FLAG，值本身写入 inlineValue
+    bool locate(uint64_t key, uint64_t &offset, uint64_t &valueLen, std::string *inlineValue = nullptr) const;
+
+    //第一个不小于 key 的键的下标，没有时返回 get_numkv()
+    int lowerBound(uint64_t key) const;
+
+    uint64_t keyAt(int index) const;
+
+    uint64_t offsetAt(int index) const;
+
+    uint64_t valueLenAt(int index) const;
+
+    bool isInlineAt(int index) const;
+
+    //内联存放的值，只能对 isInlineAt 为 true 的条目调用
+    std::string inlineValueAt(int index) const;
+
     //扫描指定键范围内的所有键值对，并返回一个包含这些键值对的向量
     std::vector <std::pair<uint64_t, std::string>> scan(uint64_t key1, uint64_t key2);
 
     bool query(uint64_t);
 
+    //使用预先计算好的哈希值查询布隆过滤器
+    bool query(const bloomHash &h) const;
+
+    const bloomFilter *getFilter() const;
+
     void write_disk() const;
 
+    //把已经写出的文件刷到磁盘
+    void sync_disk() const;
+
     void delete_disk() const;
 
     void set_id(int new_id);
 
+    //移到另一层并改用新的编号，只重命名文件，不重写内容
+    void set_level(int new_level, int new_id);
+
+    int get_id() const;
+
     uint64_t get_numkv() const;
 
     uint64_t getStamp() const;
 
+    //记一次过滤器放行但没有找到键的探测，返回累计次数
+    uint32_t addWastedProbe() const;
+
+    //清零白白探测的次数
+    void resetWastedProbes() const;
+
+    //条目引用的最小 vlog 偏移量，内联的值和删除标记不算；没有引用 vlog 时返回 UINT64_MAX
+    uint64_t getVlogBegin() const;
+
+    //文件最后修改的时间（秒），写出之后不再修改，即文件的创建时间
+    time_t modifiedTime() const;
+
+    //文件在磁盘上的字节数，包括过滤器、内联区和哈希索引
+    uint64_t diskSize() const;
+
+    //有 numKeys 个条目、内联区 inlineBytes 字节的 SSTable 的大小，转储和合并按它不超过 SSTABLESIZE 切分文件
+    static uint64_t tableSize(uint64_t numKeys, uint64_t inlineBytes, uint64_t bloomSize, bool withHashIndex);
+
     uint64_t get_maxkey() const;
 
     uint64_t get_minkey() const;
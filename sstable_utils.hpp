@@ -13,7 +13,7 @@ void SSTable::readHeader(int fd) {
 }
 
 void SSTable::initializeBloomFilter(int fd, uint64_t bloomSize) {
-    bloomfilter = new bloomFilter(bloomSize, 3);
+    bloomfilter = new bloomFilter(bloomSize, BLOOMHASHNUM);
     utils::read_file(fd, -1, bloomfilter->getM(), bloomfilter->getSet());
 }
 
@@ -38,9 +38,7 @@ std::vector<uint64_t>::const_iterator SSTable::findKey(uint64_t key) const {
 }
 
 std::string SSTable::readValueFromVlog(off_t offset, size_t size) const {
-    char buf[VLOGPADDING + size + 5] = {0};
-    utils::read_file(vlog_path, offset, VLOGPADDING + size, buf);
-    return std::string(buf + VLOGPADDING);
+    return vlog->readValue(offset, size);
 }
 
 std::string SSTable::getSSTFilename() const {
@@ -66,7 +64,90 @@ bool SSTable::findKeyInDisk(int fd, uint64_t key, off_t& offset, size_t& valueLe
     return false;
 }
 
+size_t SSTable::hashSlot(uint64_t key) const {
+    // 槽数是 2 的幂，乘法散列后取高位
+    int bits = __builtin_ctzll(hashIndex.size());
+    return bits ? (key * 0x9e3779b97f4a7c15ULL) >> (64 - bits) : 0;
+}
+
+size_t SSTable::hashIndexSlots(uint64_t numKeys) {
+    // 负载因子不超过 1/2
+    size_t slots = 1;
+    while (slots < numKeys * 2) {
+        slots <<= 1;
+    }
+    return slots;
+}
+
+void SSTable::buildHashIndex() {
+    // 线性探测
+    size_t slots = hashIndexSlots(keys.size());
+    hashIndex.assign(slots, 0);
+    for (size_t i = 0; i < keys.size(); ++i) {
+        size_t slot = hashSlot(keys[i]);
+        while (hashIndex[slot]) {
+            slot = (slot + 1) & (slots - 1);
+        }
+        hashIndex[slot] = i + 1;
+    }
+}
+
+void SSTable::readInlineData(int fd) {
+    // 内联区的长度等于所有内联条目的值长度之和
+    uint64_t len = 0;
+    for (uint64_t valueLen: valueLens) {
+        if (valueLen & INLINE_FLAG) {
+            len += valueLen & ~INLINE_FLAG;
+        }
+    }
+    inlineData.resize(len);
+    if (len) {
+        utils::read_file(fd, -1, len, &inlineData[0]);
+    }
+}
+
+void SSTable::readHashIndex(int fd, uint64_t bloomSize) {
+    // 内联区之后还有数据说明写入时带了哈希索引：[槽数 u32][各个槽 u32]
+    struct stat st;
+    off_t end = HEADERSIZE + bloomSize + head.num_kv * KOVSIZE + inlineData.size();
+    if (fstat(fd, &st) == -1 || st.st_size < end + (off_t) sizeof(uint32_t)) {
+        return;
+    }
+    uint32_t slots;
+    if (pread(fd, &slots, sizeof(slots), end) != sizeof(slots) || (slots & (slots - 1)) ||
+        st.st_size < end + (off_t) ((slots + 1) * sizeof(uint32_t))) {
+        return;
+    }
+    hashIndex.resize(slots);
+    if (pread(fd, hashIndex.data(), slots * sizeof(uint32_t), end + sizeof(uint32_t)) !=
+        (ssize_t) (slots * sizeof(uint32_t))) {
+        hashIndex.clear();
+        return;
+    }
+    // 槽中存的是条目下标加 1，0 表示空槽。越界的下标会读到键数组之外，没有空槽时找不到的键会一直探测下去，
+    // 这样的索引不可信，退回二分查找
+    bool hasEmpty = false;
+    for (uint32_t value: hashIndex) {
+        if (value > head.num_kv) {
+            hashIndex.clear();
+            return;
+        }
+        hasEmpty |= !value;
+    }
+    if (slots < 2 * head.num_kv || !hasEmpty) {
+        hashIndex.clear();
+    }
+}
+
 int SSTable::getKeyIndex(uint64_t key) const {
+    if (!hashIndex.empty()) {
+        for (size_t slot = hashSlot(key); hashIndex[slot]; slot = (slot + 1) & (hashIndex.size() - 1)) {
+            if (keys[hashIndex[slot] - 1] == key) {
+                return int(hashIndex[slot] - 1);
+            }
+        }
+        return -1;
+    }
     auto iter = findKey(key);
     if (iter != keys.end() && *iter == key) {
         return int(iter - keys.begin());
@@ -80,25 +161,23 @@ bool SSTable::isKeyDeleted(int index) const {
 
 
 std::vector<std::pair<uint64_t, std::string>> SSTable::readRangeFromVlog(int index1, int index2) const {
-    std::vector<std::pair<uint64_t, std::string>> list;
-    int fd = open(vlog_path.c_str(), O_RDWR, 0644);
-    if (fd == -1) {
-        throw std::runtime_error("Failed to open VLOG file: " + vlog_path);
-    }
-
+    // 同一次转储写出的值在 vlog 中按键相邻，合并成少数几个大块读取
+    std::vector<vlog_read> reads;
+    std::vector<std::string> vals(std::max(index2 - index1, 0));
     for (int i = index1; i < index2; ++i) {
-        off_t offset = offsets[i];
-        size_t size = valueLens[i];
-        if (size) {
-            char buf[VLOGPADDING + size + 5] = {0};
-            utils::read_file(fd, offset, size + VLOGPADDING, buf);
-            list.push_back(std::make_pair(keys[i], std::string(buf + VLOGPADDING)));
+        if (isInlineAt(i)) {
+            vals[i - index1] = inlineValueAt(i);
+        } else if (valueLens[i]) {
+            reads.push_back({(off_t) offsets[i], valueLens[i], i - index1});
         } else {
-            list.push_back(std::make_pair(keys[i], std::string("~DELETED~")));
+            vals[i - index1] = "~DELETED~";
         }
     }
-
-    close(fd);
+    vlog->readValues(reads, vals);
+    std::vector<std::pair<uint64_t, std::string>> list;
+    for (int i = index1; i < index2; ++i) {
+        list.push_back(std::make_pair(keys[i], std::move(vals[i - index1])));
+    }
     return list;
 }
 
@@ -125,6 +204,22 @@ void SSTable::writeKeyValuePairs(std::string sstFilename) const {
     }
 }
 
+void SSTable::writeInlineData(std::string sstFilename) const {
+    if (!inlineData.empty()) {
+        utils::write_file(sstFilename, -1, inlineData.size(), (void *) inlineData.data());
+    }
+}
+
+void SSTable::writeHashIndex(std::string sstFilename) const {
+    if (hashIndex.empty()) {
+        return;
+    }
+    std::vector<uint32_t> buf;
+    buf.push_back(hashIndex.size());
+    buf.insert(buf.end(), hashIndex.begin(), hashIndex.end());
+    utils::write_file(sstFilename, -1, buf.size() * sizeof(uint32_t), buf.data());
+}
+
 void SSTable::assertFileExists(const std::string& filename) const {
     assert(utils::fileExists(filename));
 }
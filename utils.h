@@ -107,6 +107,29 @@ namespace utils
         return ::unlink(path.c_str());
     }
 
+    /**
+     * Flush a file or a directory to stable storage
+     * @param path file or directory to be flushed.
+     * @return -1 if fail to open, -2 if fsync fail, and 0 if flushed successfully.
+     */
+    static inline int sync_file(const std::string &path)
+    {
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+        {
+            perror("open");
+            return -1;
+        }
+        int ret = fsync(fd);
+        close(fd);
+        if (ret != 0)
+        {
+            perror("fsync");
+            return -2;
+        }
+        return 0;
+    }
+
     /**
      * Reclaim space of a file
      * @param path file to be reclaimed.
@@ -242,6 +265,21 @@ namespace utils
         return ret == 0 && st.st_mode & S_IFREG;
     }
 
+    /**
+     * Get the last modification time of a file
+     * @param path file to be checked.
+     * @return modification time in seconds since the epoch, 0 if stat fail.
+     */
+    static inline time_t file_mtime(const std::string &path)
+    {
+        struct stat st;
+        if (stat(path.c_str(), &st) != 0)
+        {
+            return 0;
+        }
+        return st.st_mtime;
+    }
+
     /**
     * write specific length of data into specific offset in a file
     * @param path file to be write for.
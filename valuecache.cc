@@ -0,0 +1,108 @@
+#include "valuecache.h"
+
+ValueCache::ValueCache(uint64_t capacity, int shardBits) : shardBits(shardBits), hits(0), misses(0) {
+    shards = new Shard[1 << shardBits];
+    for (int i = 0; i < (1 << shardBits); i++) {
+        shards[i].usage = 0;
+    }
+    setCapacity(capacity);
+}
+
+ValueCache::~ValueCache() {
+    delete[] shards;
+}
+
+ValueCache::Shard &ValueCache::getShard(off_t offset) const {
+    //只有一个分片时移位 64 位是未定义行为
+    if (shardBits == 0) {
+        return shards[0];
+    }
+    //vlog 条目按顺序追加，偏移量的低位分布不均匀，先打散再取分片
+    uint64_t h = (uint64_t) offset * 0x9e3779b97f4a7c15ULL;
+    return shards[h >> (64 - shardBits)];
+}
+
+uint64_t ValueCache::charge(const std::string &value) {
+    return value.size() + sizeof(off_t) + sizeof(std::string);
+}
+
+void ValueCache::evict(Shard &shard) {
+    while (shard.usage > shard.capacity && !shard.lru.empty()) {
+        shard.usage -= charge(*shard.lru.back().second);
+        shard.map.erase(shard.lru.back().first);
+        shard.lru.pop_back();
+    }
+}
+
+std::shared_ptr<const std::string> ValueCache::lookup(off_t offset) {
+    Shard &shard = getShard(offset);
+    std::lock_guard<std::mutex> guard(shard.lock);
+    auto iter = shard.map.find(offset);
+    if (iter == shard.map.end()) {
+        misses++;
+        return nullptr;
+    }
+    hits++;
+    shard.lru.splice(shard.lru.begin(), shard.lru, iter->second);
+    return iter->second->second;
+}
+
+void ValueCache::insert(off_t offset, const std::string &value) {
+    Shard &shard = getShard(offset);
+    std::lock_guard<std::mutex> guard(shard.lock);
+    if (charge(value) > shard.capacity) {
+        return;
+    }
+    auto iter = shard.map.find(offset);
+    if (iter != shard.map.end()) {
+        shard.lru.splice(shard.lru.begin(), shard.lru, iter->second);
+        return;
+    }
+    shard.lru.push_front(std::make_pair(offset, std::make_shared<const std::string>(value)));
+    shard.map[offset] = shard.lru.begin();
+    shard.usage += charge(value);
+    evict(shard);
+}
+
+void ValueCache::erase(off_t begin, off_t end) {
+    for (int i = 0; i < (1 << shardBits); i++) {
+        Shard &shard = shards[i];
+        std::lock_guard<std::mutex> guard(shard.lock);
+        for (auto iter = shard.lru.begin(); iter != shard.lru.end();) {
+            if (iter->first >= begin && iter->first < end) {
+                shard.usage -= charge(*iter->second);
+                shard.map.erase(iter->first);
+                iter = shard.lru.erase(iter);
+            } else {
+                ++iter;
+            }
+        }
+    }
+}
+
+void ValueCache::clear() {
+    for (int i = 0; i < (1 << shardBits); i++) {
+        std::lock_guard<std::mutex> guard(shards[i].lock);
+        shards[i].lru.clear();
+        shards[i].map.clear();
+        shards[i].usage = 0;
+    }
+}
+
+void ValueCache::setCapacity(uint64_t capacity) {
+    for (int i = 0; i < (1 << shardBits); i++) {
+        std::lock_guard<std::mutex> guard(shards[i].lock);
+        shards[i].capacity = capacity >> shardBits;
+        evict(shards[i]);
+    }
+}
+
+cache_stats ValueCache::getStats() const {
+    cache_stats stats{hits, misses, 0, 0};
+    for (int i = 0; i < (1 << shardBits); i++) {
+        std::lock_guard<std::mutex> guard(shards[i].lock);
+        stats.usage += shards[i].usage;
+        stats.capacity += shards[i].capacity;
+    }
+    return stats;
+}
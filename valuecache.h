@@ -0,0 +1,68 @@
+#ifndef VALUECACHE_H
+#define VALUECACHE_H
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <list>
+#include <mutex>
+#include <memory>
+#include <atomic>
+#include <unordered_map>
+#include <sys/types.h>
+#include "config.h"
+
+struct cache_stats {
+    uint64_t hits; // 命中次数
+    uint64_t misses; // 未命中次数
+    uint64_t usage; // 当前缓存的字节数
+    uint64_t capacity; // 缓存容量（字节）
+};
+
+//以 vlog 偏移量为键的分片 LRU 值缓存，每个分片各自加锁
+class ValueCache {
+
+private:
+    struct Shard {
+        std::mutex lock;
+        //链表头部是最近使用的条目
+        std::list<std::pair<off_t, std::shared_ptr<const std::string>>> lru;
+        std::unordered_map<off_t, std::list<std::pair<off_t, std::shared_ptr<const std::string>>>::iterator> map;
+        uint64_t usage;
+        uint64_t capacity;
+    };
+
+    int shardBits;
+    Shard *shards;
+    std::atomic<uint64_t> hits;
+    std::atomic<uint64_t> misses;
+
+    Shard &getShard(off_t offset) const;
+    static uint64_t charge(const std::string &value);
+    void evict(Shard &shard);
+
+public:
+    ValueCache(uint64_t capacity, int shardBits);
+
+    ~ValueCache();
+
+    //查找偏移量处的值，未命中时返回空指针
+    std::shared_ptr<const std::string> lookup(off_t offset);
+
+    //读取 vlog 之后把值放入缓存
+    void insert(off_t offset, const std::string &value);
+
+    //使 [begin, end) 范围内的条目失效，gc 回收 vlog 空间后调用
+    void erase(off_t begin, off_t end);
+
+    //清空所有条目
+    void clear();
+
+    //运行时调整缓存容量，超出部分立即淘汰
+    void setCapacity(uint64_t capacity);
+
+    cache_stats getStats() const;
+};
+
+#endif //VALUECACHE_H
@@ -0,0 +1,292 @@
+#include "vlog.h"
+#include "utils.h"
+#include <algorithm>
+#include <stdexcept>
+#include <sys/uio.h>
+#include <sys/mman.h>
+
+VLog::VLog(const std::string &path, ValueCache *cache, IOBackend *io)
+        : path(path), fd(-1), head(0), cache(cache), io(io), mapLen(0) {
+    openFile();
+}
+
+VLog::~VLog() {
+    if (fd != -1) {
+        close(fd);
+    }
+}
+
+void VLog::openFile() {
+    fd = open(path.c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd == -1) {
+        throw std::runtime_error("Failed to open VLOG file: " + path);
+    }
+    head = lseek(fd, 0, SEEK_END);
+}
+
+const std::string &VLog::getPath() const {
+    return path;
+}
+
+int VLog::getFd() const {
+    return fd;
+}
+
+off_t VLog::end() const {
+    return head;
+}
+
+off_t VLog::seekData() const {
+    off_t offset = lseek(fd, 0, SEEK_DATA);
+    return offset < 0 ? head : offset;
+}
+
+bool VLog::read(off_t offset, size_t len, void *buf) const {
+    char *p = (char *) buf;
+    while (len) {
+        ssize_t count = pread(fd, p, len, offset);
+        if (count <= 0) {
+            if (count < 0) {
+                perror("pread");
+            }
+            return false;
+        }
+        p += count;
+        offset += count;
+        len -= count;
+    }
+    return true;
+}
+
+bool VLog::readHeader(off_t offset, vlog_header &header) const {
+    char buf[VLOGPADDING];
+    if (!read(offset, VLOGPADDING, buf)) {
+        return false;
+    }
+    header.magic = (uint8_t) buf[0];
+    header.checkSum = *(uint16_t *) (buf + 1);
+    header.key = *(uint64_t *) (buf + 3);
+    header.valueLen = *(uint32_t *) (buf + 11);
+    return header.magic == (uint8_t) MAGIC;
+}
+
+std::string VLog::readValue(off_t offset, size_t len) const {
+    if (cache) {
+        std::shared_ptr<const std::string> value = cache->lookup(offset);
+        if (value) {
+            return *value;
+        }
+    }
+    //头部读到定长数组里，值直接读进 string 的缓冲区，一次 preadv 完成
+    char header[VLOGPADDING];
+    std::string value(len, '\0');
+    struct iovec iov[2] = {{header, VLOGPADDING}, {&value[0], len}};
+    ssize_t count = preadv(fd, iov, 2, offset);
+    if (count != (ssize_t) (VLOGPADDING + len)) {
+        perror("preadv");
+        return std::string("");
+    }
+    // 已被 gc 回收的旧版本读出来是空洞，不放入缓存
+    if (header[0] != (char) MAGIC || *(uint32_t *) (header + 11) != len) {
+        return std::string("");
+    }
+    if (cache) {
+        cache->insert(offset, value);
+    }
+    return value;
+}
+
+Task<std::string> VLog::readValueAsync(EventLoop &loop, off_t offset, size_t len) const {
+    std::vector<std::string> vals(1);
+    std::vector<vlog_read> reads;
+    reads.push_back(vlog_read{offset, len, 0});
+    co_await readValuesAsync(loop, reads, vals);
+    co_return std::move(vals[0]);
+}
+
+Task<void> VLog::readValuesAsync(EventLoop &loop, std::vector<vlog_read> reads, std::vector<std::string> &vals) const {
+    std::vector<io_request> reqs;
+    std::vector<size_t> first;
+    std::vector<std::vector<char>> bufs;
+    planReads(reads, vals, reqs, first, bufs);
+    for (auto &req: reqs) {
+        req.fd = fd;
+    }
+    co_await loop.readAll(reqs);
+    sliceValues(reads, reqs, first, vals);
+}
+
+std::shared_ptr<const char> VLog::getMapping(off_t end) const {
+    std::lock_guard<std::mutex> guard(mapLock);
+    if (!mapping || mapLen < end) {
+        // 旧的映射由仍在使用它的句柄继续持有，这里只替换成覆盖整个文件的新映射
+        off_t len = head;
+        void *addr = mmap(nullptr, len, PROT_READ, MAP_SHARED, fd, 0);
+        if (addr == MAP_FAILED) {
+            perror("mmap");
+            return nullptr;
+        }
+        mapping = std::shared_ptr<const char>((const char *) addr, [len](const char *p) {
+            munmap((void *) p, len);
+        });
+        mapLen = len;
+    }
+    return mapping;
+}
+
+bool VLog::readValue(off_t offset, size_t len, ValueHandle &handle) const {
+    if (cache) {
+        std::shared_ptr<const std::string> value = cache->lookup(offset);
+        if (value) {
+            handle = ValueHandle(value, value->data(), value->size());
+            return true;
+        }
+    }
+    if (offset + VLOGPADDING + (off_t) len > head) {
+        return false;
+    }
+    std::shared_ptr<const char> map = getMapping(offset + VLOGPADDING + len);
+    if (!map) {
+        return false;
+    }
+    const char *header = map.get() + offset;
+    if (header[0] != (char) MAGIC || *(uint32_t *) (header + 11) != len) {
+        return false;
+    }
+    handle = ValueHandle(map, header + VLOGPADDING, len);
+    return true;
+}
+
+bool VLog::readBatch(std::vector<io_request> &reqs) const {
+    for (auto &req: reqs) {
+        req.fd = fd;
+    }
+    if (io) {
+        io->readBatch(reqs);
+    } else {
+        for (auto &req: reqs) {
+            req.result = read(req.offset, req.len, req.buf) ? (ssize_t) req.len : -1;
+        }
+    }
+    bool ok = true;
+    for (const auto &req: reqs) {
+        if (req.result != (ssize_t) req.len) {
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+void VLog::planReads(std::vector<vlog_read> &reads, std::vector<std::string> &vals, std::vector<io_request> &reqs,
+                     std::vector<size_t> &first, std::vector<std::vector<char>> &bufs) const {
+    // 先查缓存，剩下的按偏移量排序，相邻或间隔不超过 COALESCE_GAP 的条目合并成一个不超过 COALESCE_MAX 的请求
+    size_t n = 0;
+    for (size_t i = 0; i < reads.size(); i++) {
+        std::shared_ptr<const std::string> value = cache ? cache->lookup(reads[i].offset) : nullptr;
+        if (value) {
+            vals[reads[i].slot] = *value;
+        } else {
+            reads[n++] = reads[i];
+        }
+    }
+    reads.resize(n);
+    std::sort(reads.begin(), reads.end());
+    for (size_t i = 0; i < reads.size();) {
+        off_t begin = reads[i].offset;
+        off_t end = begin + VLOGPADDING + reads[i].valueLen;
+        size_t j = i + 1;
+        while (j < reads.size() && reads[j].offset <= end + COALESCE_GAP &&
+               reads[j].offset + VLOGPADDING + reads[j].valueLen - begin <= COALESCE_MAX) {
+            end = std::max(end, (off_t) (reads[j].offset + VLOGPADDING + reads[j].valueLen));
+            j++;
+        }
+        io_request req{};
+        req.offset = begin;
+        req.len = end - begin;
+        reqs.push_back(req);
+        first.push_back(i);
+        i = j;
+    }
+    first.push_back(reads.size());
+    bufs.resize(reqs.size());
+    for (size_t r = 0; r < reqs.size(); r++) {
+        bufs[r].resize(reqs[r].len);
+        reqs[r].buf = bufs[r].data();
+    }
+}
+
+void VLog::sliceValues(const std::vector<vlog_read> &reads, const std::vector<io_request> &reqs,
+                       const std::vector<size_t> &first, std::vector<std::string> &vals) const {
+    for (size_t r = 0; r < reqs.size(); r++) {
+        // 读取失败或者读短时，读到的部分之外的值按没有找到处理，与同步读取 readValue 失败时一致
+        size_t got = reqs[r].result > 0 ? reqs[r].result : 0;
+        for (size_t i = first[r]; i < first[r + 1]; i++) {
+            size_t begin = reads[i].offset - reqs[r].offset;
+            const char *header = reqs[r].buf + begin;
+            // 已被 gc 回收的旧版本读出来是空洞，不放入缓存
+            if (begin + VLOGPADDING + reads[i].valueLen > got || header[0] != (char) MAGIC ||
+                *(uint32_t *) (header + 11) != reads[i].valueLen) {
+                vals[reads[i].slot] = "";
+                continue;
+            }
+            vals[reads[i].slot].assign(header + VLOGPADDING, reads[i].valueLen);
+            if (cache) {
+                cache->insert(reads[i].offset, vals[reads[i].slot]);
+            }
+        }
+    }
+}
+
+void VLog::readValues(std::vector<vlog_read> &reads, std::vector<std::string> &vals) const {
+    std::vector<io_request> reqs;
+    std::vector<size_t> first;
+    std::vector<std::vector<char>> bufs;
+    planReads(reads, vals, reqs, first, bufs);
+    readBatch(reqs);
+    sliceValues(reads, reqs, first, vals);
+}
+
+off_t VLog::append(const void *buf, size_t len) {
+    off_t offset = head;
+    const char *p = (const char *) buf;
+    while (len) {
+        ssize_t count = pwrite(fd, p, len, head);
+        if (count <= 0) {
+            perror("pwrite");
+            throw std::runtime_error("Failed to write VLOG file: " + path);
+        }
+        p += count;
+        head += count;
+        len -= count;
+    }
+    return offset;
+}
+
+int VLog::punchHole(off_t offset, off_t len) {
+    if (cache) {
+        cache->erase(offset, offset + len);
+    }
+    // 与 utils::de_alloc_file 相同，起点按页对齐
+    len += offset % PAGE_SIZE;
+    offset = offset / PAGE_SIZE * PAGE_SIZE;
+    if (fallocate(fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, offset, len) < 0) {
+        perror("fallocate");
+        return -2;
+    }
+    return 0;
+}
+
+void VLog::reset() {
+    close(fd);
+    utils::rmfile(path);
+    {
+        std::lock_guard<std::mutex> guard(mapLock);
+        mapping.reset();
+        mapLen = 0;
+    }
+    // vlog 被删除后偏移量会从头开始复用，缓存必须清空
+    if (cache) {
+        cache->clear();
+    }
+    openFile();
+}
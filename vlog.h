@@ -0,0 +1,126 @@
+#ifndef VLOG_H
+#define VLOG_H
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <sys/types.h>
+#include "config.h"
+#include "valuecache.h"
+#include "iobackend.h"
+#include "eventloop.h"
+
+struct vlog_header {
+    uint8_t magic; // 魔数，固定为 MAGIC
+    uint16_t checkSum; // 键、值长度和值的 crc16
+    uint64_t key; // 键
+    uint32_t valueLen; // 值的长度
+};
+
+//指向一个值的只读句柄，值本身不被复制：句柄持有 vlog 的只读映射或缓存条目，自身销毁前指向的内存一直有效。
+//注意 gc 回收的 vlog 空间在映射中会读出 0，不要跨越 gc 持有句柄
+class ValueHandle {
+
+private:
+    std::shared_ptr<const void> owner; //保证 ptr 指向的内存不被释放
+    const char *ptr;
+    size_t len;
+
+public:
+    ValueHandle() : ptr(nullptr), len(0) {}
+
+    ValueHandle(std::shared_ptr<const void> owner, const char *ptr, size_t len)
+            : owner(std::move(owner)), ptr(ptr), len(len) {}
+
+    const char *data() const { return ptr; }
+
+    size_t size() const { return len; }
+
+    bool empty() const { return len == 0; }
+
+    std::string toString() const { return std::string(ptr, len); }
+
+    void reset() {
+        owner.reset();
+        ptr = nullptr;
+        len = 0;
+    }
+};
+
+//vlog 文件，在 KVStore 的整个生命周期内保持打开，所有读取都用 pread 指定偏移量，可以并发读
+class VLog {
+
+private:
+    std::string path;
+    int fd;
+    off_t head; //文件末尾，新的条目从这里追加
+    ValueCache *cache; //值缓存，由 KVStore 持有，可以为空
+    IOBackend *io; //异步读后端，由 KVStore 持有，为空时退回同步的 pread
+    mutable std::mutex mapLock;
+    mutable std::shared_ptr<const char> mapping; //vlog 的只读映射，文件变长后按需重新映射
+    mutable off_t mapLen;
+
+    void openFile();
+    //查缓存并把未命中的条目按偏移量合并成读请求，first[r] 是第 r 个请求覆盖的第一个条目
+    void planReads(std::vector<vlog_read> &reads, std::vector<std::string> &vals, std::vector<io_request> &reqs,
+                   std::vector<size_t> &first, std::vector<std::vector<char>> &bufs) const;
+    //从读完的请求中切出各个值并放入缓存
+    void sliceValues(const std::vector<vlog_read> &reads, const std::vector<io_request> &reqs,
+                     const std::vector<size_t> &first, std::vector<std::string> &vals) const;
+    std::shared_ptr<const char> getMapping(off_t end) const;
+
+public:
+    VLog(const std::string &path, ValueCache *cache, IOBackend *io);
+
+    ~VLog();
+
+    const std::string &getPath() const;
+
+    int getFd() const;
+
+    //文件末尾的偏移量
+    off_t end() const;
+
+    //第一个有数据的块的偏移量，文件为空时返回 end()
+    off_t seekData() const;
+
+    //从 offset 开始读取 len 个字节，全部读到时返回 true
+    bool read(off_t offset, size_t len, void *buf) const;
+
+    //解析 offset 处 VLOGPADDING 字节的条目头部
+    bool readHeader(off_t offset, vlog_header &header) const;
+
+    //读取 offset 处条目的值，len 为值的长度；先查缓存，未命中时读取后放入缓存
+    std::string readValue(off_t offset, size_t len) const;
+
+    //读取 offset 处条目的值但不复制：命中缓存时句柄持有缓存条目，否则直接指向 vlog 的只读映射
+    bool readValue(off_t offset, size_t len, ValueHandle &handle) const;
+
+    //readValue 的协程版本：缓存未命中时在 loop 上挂起等待读取完成
+    Task<std::string> readValueAsync(EventLoop &loop, off_t offset, size_t len) const;
+
+    //readValues 的协程版本，所有读取同时在途，全部完成后恢复
+    Task<void> readValuesAsync(EventLoop &loop, std::vector<vlog_read> reads, std::vector<std::string> &vals) const;
+
+    //一次提交多个读请求并等待全部完成，请求的 fd 由这里填写；返回是否全部读满
+    bool readBatch(std::vector<io_request> &reqs) const;
+
+    //批量读取多个条目的值，结果写入 vals[slot]，已被 gc 回收的条目读出空串；
+    //按偏移量排序后合并相邻的读取，合并后的请求一起提交，同时在途
+    void readValues(std::vector<vlog_read> &reads, std::vector<std::string> &vals) const;
+
+    //在文件末尾追加一段数据，返回写入位置的偏移量
+    off_t append(const void *buf, size_t len);
+
+    //回收 [offset, offset + len) 的空间，并使缓存中对应的条目失效
+    int punchHole(off_t offset, off_t len);
+
+    //删除 vlog 文件并重新创建一个空文件
+    void reset();
+};
+
+#endif //VLOG_H